@@ -0,0 +1,330 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      // fclose, fopen, fprintf, fputc, fread
+#include <stdbool.h>    // bool
+#include <stdint.h>     // intptr_t, uint64_t
+#include <stdlib.h>     // malloc, free, strtol
+#include <string.h>     // strcmp
+#include <errno.h>      // errno
+#include <fcntl.h>      // open
+#include <sys/stat.h>   // fstat
+#include <time.h>       // clock_gettime
+#include <unistd.h>     // close
+
+#include "loesung.h"
+
+/**
+ * Benchmark of the loesung library. Loads a dictionary and translates a text a number of times and times every phase
+ * on its own:
+ * 1. Reading the wb.file (or mapping the image).
+ * 2. Building the hash table.
+ * 3. Looking up every word of the text with loesung_lookup_batch() in batches of --batch words, without any output.
+ * 4. Translating the text like the command line does, the output goes to /dev/null.
+ * The results are printed as JSON to stdout, with the best and the mean time of every phase. With --huge-pages the
+ * dictionary asks for huge pages and the report tells how many it got. With --use-profile the hash table is laid out by
+ * a profile, which counts to the build.
+ */
+
+/* Data structure for the times of a phase. */
+struct Phase {
+    const char *name;
+    double best;
+    double total;
+};
+
+/* Data structure for the settings of the benchmark. */
+struct Settings {
+    long runs;
+    long threads;
+    long cache_size;
+    long batch_size;
+    bool use_huge_pages;
+    const char *profile_path;
+};
+
+// Phases of the benchmark.
+#define PHASE_READ 0
+#define PHASE_BUILD 1
+#define PHASE_LOOKUP 2
+#define PHASE_TRANSLATE 3
+#define PHASE_COUNT 4
+
+/* Function prototypes for the benchmark. */
+double wall_time(void);
+bool parse_count(const char *, long, long, long *);
+void add_time(struct Phase *, double);
+int translate_text(const struct Loesung_dictionary *, const struct Settings *, const char *, int);
+char *read_text(const char *, size_t *);
+struct Loesung_token *split_text(const char *, size_t, uint64_t *);
+bool is_text_letter(int);
+void print_string(FILE *, const char *);
+void print_report(FILE *, const struct Phase *, const char **, const struct Settings *, uint64_t, uint64_t, size_t,
+                  uint64_t, uint64_t);
+
+/* Program main entry point. */
+int main(int argc, char *argv[]) {
+    struct Settings settings = {3, 1, LOESUNG_DEFAULT_CACHE_SIZE, LOESUNG_DEFAULT_BATCH_SIZE, false, NULL};
+    int arg = 1;
+
+    while (arg < argc - 2) {
+        if (strcmp(argv[arg], "-r") == 0 && parse_count(argv[arg + 1], 1, 1000, &settings.runs))
+            arg += 2;
+        else if (strcmp(argv[arg], "-j") == 0 && parse_count(argv[arg + 1], 1, LOESUNG_MAX_THREADS, &settings.threads))
+            arg += 2;
+        else if (strcmp(argv[arg], "--cache") == 0 &&
+                 parse_count(argv[arg + 1], 0, LOESUNG_MAX_CACHE_SIZE, &settings.cache_size))
+            arg += 2;
+        else if (strcmp(argv[arg], "--batch") == 0 &&
+                 parse_count(argv[arg + 1], 1, LOESUNG_MAX_BATCH_SIZE, &settings.batch_size))
+            arg += 2;
+        else if (strcmp(argv[arg], "--huge-pages") == 0) {
+            settings.use_huge_pages = true;
+            arg++;
+        } else if (strcmp(argv[arg], "--use-profile") == 0) {
+            settings.profile_path = argv[arg + 1];
+            arg += 2;
+        } else
+            break;
+    }
+
+    if (arg != argc - 2) {
+        fprintf(stderr, "Usage: %s [-r runs] [-j threads] [--cache entries] [--batch words] [--huge-pages] "
+                        "[--use-profile profile] filename text\n", argv[0]);
+        return 2;
+    }
+
+    const char *paths[2] = {argv[arg], argv[arg + 1]};
+    struct Phase phases[PHASE_COUNT] = {{"read_wb_file", 0, 0}, {"build_table", 0, 0}, {"lookup", 0, 0},
+                                        {"translate", 0, 0}};
+
+    // The lookups run on a copy of the text which is split into words once.
+    size_t text_size;
+    uint64_t word_count;
+    char *text = read_text(paths[1], &text_size);
+    struct Loesung_token *words = text != NULL ? split_text(text, text_size, &word_count) : NULL;
+    const char **translations = words != NULL ? malloc((word_count + 1) * sizeof(const char *)) : NULL;
+    struct Loesung_dictionary *dict = loesung_create_dictionary();
+    int null_fd = open("/dev/null", O_WRONLY);
+
+    if (translations == NULL || dict == NULL || null_fd == -1) {
+        fprintf(stderr, "Error: could not start the benchmark with %s!\n", paths[1]);
+        return 2;
+    }
+    loesung_set_huge_pages(dict, settings.use_huge_pages);
+
+    uint64_t entries = 0;
+    uint64_t huge_pages = 0;
+    uint64_t found = 0;
+
+    for (long run = 0; run < settings.runs; run++) {
+        double start = wall_time();
+        int ret;
+
+        if (loesung_is_image(paths[0])) {
+            ret = loesung_map_image(dict, paths[0]);
+            add_time(&phases[PHASE_READ], wall_time() - start);
+            add_time(&phases[PHASE_BUILD], 0);
+        } else {
+            ret = loesung_read_wb_file(dict, paths[0]);
+            double read = wall_time();
+            add_time(&phases[PHASE_READ], read - start);
+
+            if (ret == LOESUNG_OK)
+                ret = loesung_build_table(dict, settings.threads);
+            if (ret == LOESUNG_OK && settings.profile_path != NULL)
+                ret = loesung_apply_profile(dict, settings.profile_path, NULL);
+            add_time(&phases[PHASE_BUILD], wall_time() - read);
+        }
+
+        if (ret != LOESUNG_OK) {
+            fprintf(stderr, "%s\n", loesung_error(dict));
+            return 2;
+        }
+        entries = loesung_entries(dict);
+
+        // Count the huge pages while the table is in use, reading /proc/self/smaps isn't timed.
+        if (settings.use_huge_pages) {
+            struct Loesung_table_stats table;
+            loesung_table_stats(dict, &table);
+            huge_pages = table.huge_pages;
+        }
+
+        start = wall_time();
+        found = 0;
+        for (uint64_t first = 0; first < word_count; first += (uint64_t) settings.batch_size) {
+            uint64_t batch = word_count - first;
+            if (batch > (uint64_t) settings.batch_size)
+                batch = (uint64_t) settings.batch_size;
+            found += loesung_lookup_batch(dict, words + first, (size_t) batch, translations + first);
+        }
+        add_time(&phases[PHASE_LOOKUP], wall_time() - start);
+
+        start = wall_time();
+        ret = translate_text(dict, &settings, paths[1], null_fd);
+        add_time(&phases[PHASE_TRANSLATE], wall_time() - start);
+
+        if (loesung_translation_error(ret) != NULL) {
+            fprintf(stderr, "%s\n", loesung_translation_error(ret));
+            return 2;
+        }
+    }
+
+    print_report(stdout, phases, paths, &settings, entries, huge_pages, text_size, word_count, found);
+    loesung_delete_dictionary(dict);
+    close(null_fd);
+    free(translations);
+    free(words);
+    free(text);
+    return 0;
+}
+
+/* Functions for the benchmark. */
+/* Return the time of a monotonic clock in seconds. */
+double wall_time(void) {
+    struct timespec time;
+
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
+}
+
+/* Parse a decimal number between min and max. */
+bool parse_count(const char *arg, long min, long max, long *count) {
+    char *end;
+
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || value < min || value > max)
+        return false;
+
+    *count = value;
+    return true;
+}
+
+/* Add the time of a run to a phase. */
+void add_time(struct Phase *phase, double time) {
+    if (phase->total == 0 || time < phase->best)
+        phase->best = time;
+    phase->total += time;
+}
+
+/* Translate the text to out_fd like the command line, with more than one thread in parallel. */
+int translate_text(const struct Loesung_dictionary *dict, const struct Settings *settings, const char *path,
+                   int out_fd) {
+    int text_fd = open(path, O_RDONLY);
+    void *context = (void *) (intptr_t) out_fd;
+    int ret = LOESUNG_NO_MEMORY;
+
+    if (text_fd == -1) {
+        fprintf(stderr, "Error opening file %s!\n", path);
+        exit(2);
+    }
+
+    struct Loesung_translator *translator = loesung_create_translator(dict, (uint64_t) settings->cache_size);
+    if (translator != NULL) {
+        loesung_set_batch_size(translator, (uint64_t) settings->batch_size);
+        ret = settings->threads > 1 ? loesung_translate_parallel(translator, text_fd, loesung_write_fd, context,
+                                                                 settings->threads)
+                                    : loesung_translate_stream(translator, text_fd, loesung_write_fd, context);
+    }
+    loesung_delete_translator(translator);
+
+    close(text_fd);
+    return ret;
+}
+
+/* Read the whole text into memory. Returns NULL on an error. */
+char *read_text(const char *path, size_t *size) {
+    FILE *file_pointer = fopen(path, "rb");
+    struct stat file_stat;
+
+    if (file_pointer == NULL || fstat(fileno(file_pointer), &file_stat) == -1) {
+        if (file_pointer != NULL)
+            fclose(file_pointer);
+        return NULL;
+    }
+
+    *size = (size_t) file_stat.st_size;
+    char *text = malloc(*size + 1);
+    if (text != NULL && fread(text, 1, *size, file_pointer) != *size) {
+        free(text);
+        text = NULL;
+    }
+
+    fclose(file_pointer);
+    return text;
+}
+
+/* Split the text into words like the translation does. */
+struct Loesung_token *split_text(const char *text, size_t size, uint64_t *word_count) {
+    uint64_t capacity = size / 2 + 1;
+    struct Loesung_token *words = malloc(capacity * sizeof(struct Loesung_token));
+    *word_count = 0;
+
+    for (size_t i = 0; words != NULL && i < size;) {
+        if (!is_text_letter(text[i])) {
+            i++;
+            continue;
+        }
+
+        struct Loesung_token *word = &words[(*word_count)++];
+        word->word = text + i;
+
+        while (i < size && is_text_letter(text[i]))
+            i++;
+        word->len = (size_t) (text + i - word->word);
+    }
+
+    return words;
+}
+
+/* Helper function to check if a character is a letter. */
+bool is_text_letter(int input) {
+    return (((input >= 'A') && (input <= 'Z')) || ((input >= 'a' && input <= 'z')));
+}
+
+/* Print a string as JSON string. */
+void print_string(FILE *file, const char *string) {
+    fputc('"', file);
+    for (; *string != '\0'; string++) {
+        if (*string == '"' || *string == '\\')
+            fputc('\\', file);
+        if ((unsigned char) *string >= ' ')
+            fputc(*string, file);
+    }
+    fputc('"', file);
+}
+
+/* Print the results as JSON. The rates are computed from the best times. */
+void print_report(FILE *file, const struct Phase *phases, const char **paths, const struct Settings *settings,
+                  uint64_t entries, uint64_t huge_pages, size_t text_size, uint64_t word_count, uint64_t found) {
+    double runs = (double) settings->runs;
+
+    fprintf(file, "{\n  \"dictionary\": ");
+    print_string(file, paths[0]);
+    fprintf(file, ",\n  \"text\": ");
+    print_string(file, paths[1]);
+    fprintf(file, ",\n  \"runs\": %ld,\n  \"threads\": %ld,\n  \"cache\": %ld,\n  \"batch\": %ld,\n", settings->runs,
+            settings->threads, settings->cache_size, settings->batch_size);
+    fprintf(file, "  \"huge_pages\": %s,\n  \"huge_pages_granted\": %lu,\n  \"profile\": ",
+            settings->use_huge_pages ? "true" : "false", huge_pages);
+    if (settings->profile_path != NULL)
+        print_string(file, settings->profile_path);
+    else
+        fprintf(file, "null");
+    fprintf(file, ",\n");
+    fprintf(file, "  \"entries\": %lu,\n  \"text_bytes\": %lu,\n  \"words\": %lu,\n  \"found\": %lu,\n", entries,
+            text_size, word_count, found);
+
+    fprintf(file, "  \"phases\": {\n");
+    for (int i = 0; i < PHASE_COUNT; i++)
+        fprintf(file, "    \"%s\": {\"best_s\": %.6f, \"mean_s\": %.6f}%s\n", phases[i].name, phases[i].best,
+                phases[i].total / runs, i + 1 < PHASE_COUNT ? "," : "");
+    fprintf(file, "  },\n");
+
+    double load = phases[PHASE_READ].best + phases[PHASE_BUILD].best;
+    fprintf(file, "  \"load_entries_per_s\": %.0f,\n", load > 0 ? (double) entries / load : 0.0);
+    fprintf(file, "  \"lookups_per_s\": %.0f,\n",
+            phases[PHASE_LOOKUP].best > 0 ? (double) word_count / phases[PHASE_LOOKUP].best : 0.0);
+    fprintf(file, "  \"translate_mb_per_s\": %.2f\n}\n",
+            phases[PHASE_TRANSLATE].best > 0 ? (double) text_size / 1e6 / phases[PHASE_TRANSLATE].best : 0.0);
+}
@@ -0,0 +1,339 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      // fclose, fopen, fprintf, fputc, fputs, fwrite
+#include <stdbool.h>    // bool
+#include <stdint.h>     // uint64_t
+#include <stdlib.h>     // calloc, malloc, free, strtod, strtoul
+#include <string.h>     // memcmp, memcpy, strchr, strcmp
+#include <math.h>       // pow
+
+/**
+ * Generator of a synthetic wb.file and a text to translate with it. The words of the dictionary are random lowercase
+ * words, the text picks them by a Zipf distribution, so a few words are very frequent and most are rare, like in real
+ * text. Some words of the text are not in the dictionary and some are capitalized. The same seed gives the same files.
+ */
+
+// A word of the set is stored as its length byte and its letters.
+#define MAX_WORD_LENGTH 255u
+
+/* Data structure for the settings of the generator. The word lengths are uniform between min_length and max_length,
+ * unless is_weighted is set: then length_cdf holds the cumulative weights of the lengths, the one of length n at n. */
+struct Settings {
+    uint64_t entries;
+    uint64_t words;
+    uint64_t min_length;
+    uint64_t max_length;
+    double zipf;
+    double unknown;
+    double capitals;
+    uint64_t seed;
+    bool is_weighted;
+    double length_cdf[MAX_WORD_LENGTH + 1];
+};
+
+/* Data structure for a set of words. All words are stored in one buffer, the table holds their offset plus one. */
+struct Word_set {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    uint64_t *table;
+    uint64_t table_size;
+};
+
+/* Function prototypes for the random numbers. */
+uint64_t next_random(uint64_t *);
+double next_unit(uint64_t *);
+
+/* Function prototypes for the word set. */
+bool add_word(struct Word_set *, const unsigned char *, size_t);
+bool contains_word(const struct Word_set *, const unsigned char *, size_t, uint64_t *);
+uint64_t word_hash(const unsigned char *, size_t);
+
+/* Function prototypes for the generator. */
+size_t random_word(uint64_t *, const struct Settings *, unsigned char *);
+uint64_t pick_zipf(const double *, uint64_t, double);
+bool parse_settings(int, char **, struct Settings *, int *);
+bool parse_lengths(const char *, struct Settings *, char **);
+int generate(const struct Settings *, const char *, const char *);
+
+/* Program main entry point. */
+int main(int argc, char *argv[]) {
+    struct Settings settings = {100000, 1000000, 2, 12, 1.0, 0.05, 0.1, 1, false, {0}};
+    int arg = 1;
+
+    if (!parse_settings(argc, argv, &settings, &arg) || arg != argc - 2) {
+        fprintf(stderr, "Usage: %s [--entries n] [--words n] [--length min:max|length=weight,...] [--zipf s] "
+                        "[--unknown ratio] [--capitals ratio] [--seed n] wb-file text-file\n", argv[0]);
+        return 2;
+    }
+
+    return generate(&settings, argv[arg], argv[arg + 1]);
+}
+
+/* Functions for the random numbers. */
+/* SplitMix64, fast and good enough for test data. */
+uint64_t next_random(uint64_t *state) {
+    uint64_t x = (*state += 0x9e3779b97f4a7c15u);
+    x = (x ^ (x >> 30u)) * 0xbf58476d1ce4e5b9u;
+    x = (x ^ (x >> 27u)) * 0x94d049bb133111ebu;
+    return x ^ (x >> 31u);
+}
+
+/* A random number in [0, 1). */
+double next_unit(uint64_t *state) {
+    return (double) (next_random(state) >> 11u) / (double) (1ull << 53u);
+}
+
+/* Functions for the word set. */
+/* FNV-1a hash of a word. */
+uint64_t word_hash(const unsigned char *word, size_t len) {
+    uint64_t hash = 0xcbf29ce484222325u;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ word[i]) * 0x100000001b3u;
+
+    return hash;
+}
+
+/* Look for a word in the set. slot is set to the slot of the word or the free slot it would go to. */
+bool contains_word(const struct Word_set *set, const unsigned char *word, size_t len, uint64_t *slot) {
+    uint64_t i = word_hash(word, len) & (set->table_size - 1);
+
+    while (set->table[i] != 0) {
+        const unsigned char *item = set->data + set->table[i] - 1;
+        if (item[0] == len && memcmp(item + 1, word, len) == 0)
+            break;
+        i = (i + 1) & (set->table_size - 1);
+    }
+
+    *slot = i;
+    return set->table[i] != 0;
+}
+
+/* Add a word to the set. Returns false if it is in there already. The table must have room for it. */
+bool add_word(struct Word_set *set, const unsigned char *word, size_t len) {
+    uint64_t slot;
+
+    if (contains_word(set, word, len, &slot))
+        return false;
+
+    set->data[set->length] = (unsigned char) len;
+    memcpy(set->data + set->length + 1, word, len);
+    set->table[slot] = set->length + 1;
+    set->length += len + 1;
+    return true;
+}
+
+/* Functions for the generator. */
+/* Write a random lowercase word to word, its length is picked by the weights of the lengths or between the minimum
+ * and maximum. The weights are searched from the minimum on, the shorter lengths have none. Returns the length. */
+size_t random_word(uint64_t *state, const struct Settings *settings, unsigned char *word) {
+    size_t len = settings->min_length;
+
+    if (settings->is_weighted)
+        len += pick_zipf(settings->length_cdf + len, MAX_WORD_LENGTH + 1 - len, next_unit(state));
+    else
+        len += next_random(state) % (settings->max_length - settings->min_length + 1);
+
+    for (size_t i = 0; i < len; i++)
+        word[i] = (unsigned char) ('a' + next_random(state) % 26);
+
+    return len;
+}
+
+/* Pick a rank from the cumulative distribution by binary search. */
+uint64_t pick_zipf(const double *cdf, uint64_t count, double unit) {
+    uint64_t low = 0;
+    uint64_t high = count - 1;
+
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (cdf[mid] < unit)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    return low;
+}
+
+/* Parse the options in front of the file names. Returns false on an invalid option. */
+bool parse_settings(int argc, char **argv, struct Settings *settings, int *arg) {
+    while (*arg < argc - 2 && argv[*arg][0] == '-') {
+        const char *name = argv[*arg];
+        const char *value = argv[*arg + 1];
+        char *end;
+
+        if (strcmp(name, "--entries") == 0)
+            settings->entries = strtoul(value, &end, 10);
+        else if (strcmp(name, "--words") == 0)
+            settings->words = strtoul(value, &end, 10);
+        else if (strcmp(name, "--length") == 0 && strchr(value, '=') != NULL) {
+            if (!parse_lengths(value, settings, &end))
+                return false;
+        } else if (strcmp(name, "--length") == 0) {
+            settings->min_length = strtoul(value, &end, 10);
+            if (*end != ':')
+                return false;
+            settings->max_length = strtoul(end + 1, &end, 10);
+            settings->is_weighted = false;
+        } else if (strcmp(name, "--zipf") == 0)
+            settings->zipf = strtod(value, &end);
+        else if (strcmp(name, "--unknown") == 0)
+            settings->unknown = strtod(value, &end);
+        else if (strcmp(name, "--capitals") == 0)
+            settings->capitals = strtod(value, &end);
+        else if (strcmp(name, "--seed") == 0)
+            settings->seed = strtoul(value, &end, 10);
+        else
+            return false;
+
+        if (*end != '\0')
+            return false;
+        *arg += 2;
+    }
+
+    return settings->entries > 0 && settings->min_length > 0 && settings->min_length <= settings->max_length &&
+           settings->max_length <= MAX_WORD_LENGTH && settings->zipf >= 0 && settings->unknown >= 0 &&
+           settings->unknown <= 1 && settings->capitals >= 0 && settings->capitals <= 1;
+}
+
+/* Parse a list of word lengths with their weights like 2=10,3=25,4=20 into the cumulative weights of the settings. The
+ * weights don't need to add up to anything, lengths which are not listed don't occur. end is set behind the list.
+ * Returns false if a length is out of range, a weight is negative or all of them are zero. */
+bool parse_lengths(const char *value, struct Settings *settings, char **end) {
+    double weights[MAX_WORD_LENGTH + 1] = {0};
+    double sum = 0;
+
+    while (true) {
+        uint64_t length = strtoul(value, end, 10);
+        if (**end != '=' || length == 0 || length > MAX_WORD_LENGTH)
+            return false;
+        double weight = strtod(*end + 1, end);
+        if (weight < 0)
+            return false;
+        weights[length] += weight;
+
+        if (**end != ',')
+            break;
+        value = *end + 1;
+    }
+
+    settings->min_length = 0;
+    for (uint64_t length = 1; length <= MAX_WORD_LENGTH; length++) {
+        if (weights[length] > 0 && settings->min_length == 0)
+            settings->min_length = length;
+        if (weights[length] > 0)
+            settings->max_length = length;
+        sum += weights[length];
+        settings->length_cdf[length] = sum;
+    }
+
+    if (sum <= 0)
+        return false;
+    for (uint64_t length = 0; length <= MAX_WORD_LENGTH; length++)
+        settings->length_cdf[length] /= sum;
+    settings->is_weighted = true;
+    return true;
+}
+
+/* Write the wb.file and the text. */
+int generate(const struct Settings *settings, const char *wb_path, const char *text_path) {
+    uint64_t state = settings->seed;
+    unsigned char word[MAX_WORD_LENGTH];
+    unsigned char translation[MAX_WORD_LENGTH];
+
+    // The table of the set is at most a quarter full.
+    struct Word_set set = {NULL, 0, 0, NULL, 1};
+    while (set.table_size < 4 * settings->entries)
+        set.table_size *= 2;
+    set.capacity = settings->entries * (settings->max_length + 1);
+    set.data = malloc(set.capacity);
+    set.table = calloc(set.table_size, sizeof(uint64_t));
+    uint64_t *offsets = malloc(settings->entries * sizeof(uint64_t));
+    double *cdf = malloc(settings->entries * sizeof(double));
+
+    FILE *wb_file = fopen(wb_path, "w");
+    FILE *text_file = fopen(text_path, "w");
+
+    if (set.data == NULL || set.table == NULL || offsets == NULL || cdf == NULL || wb_file == NULL ||
+        text_file == NULL) {
+        fprintf(stderr, "Error: could not create %s and %s!\n", wb_path, text_path);
+        return 2;
+    }
+
+    // Draw distinct words for the dictionary. Give up if there are not enough words of the lengths.
+    uint64_t tries = 0;
+    for (uint64_t i = 0; i < settings->entries; i++) {
+        size_t len;
+        do {
+            if (++tries > 100 * settings->entries) {
+                fprintf(stderr, "Error: there are not %lu words of length %lu to %lu!\n", settings->entries,
+                        settings->min_length, settings->max_length);
+                return 2;
+            }
+            len = random_word(&state, settings, word);
+            offsets[i] = set.length;
+        } while (!add_word(&set, word, len));
+
+        size_t translation_len = random_word(&state, settings, translation);
+        fwrite(word, 1, len, wb_file);
+        fputc(':', wb_file);
+        fwrite(translation, 1, translation_len, wb_file);
+        fputc('\n', wb_file);
+    }
+
+    // The word of rank k is picked with a weight of 1 / k^s.
+    double sum = 0;
+    for (uint64_t i = 0; i < settings->entries; i++) {
+        sum += 1.0 / pow((double) (i + 1), settings->zipf);
+        cdf[i] = sum;
+    }
+    for (uint64_t i = 0; i < settings->entries; i++)
+        cdf[i] /= sum;
+
+    // Write the text, with some punctuation and a line break now and then.
+    for (uint64_t i = 0; i < settings->words; i++) {
+        size_t len;
+        uint64_t slot;
+
+        if (next_unit(&state) < settings->unknown) {
+            // If the dictionary has almost all words of the lengths, an unknown word may be hard to find.
+            uint64_t word_tries = 0;
+            do
+                len = random_word(&state, settings, word);
+            while (contains_word(&set, word, len, &slot) && ++word_tries < 1000);
+        } else {
+            const unsigned char *item = set.data + offsets[pick_zipf(cdf, settings->entries, next_unit(&state))];
+            len = item[0];
+            memcpy(word, item + 1, len);
+        }
+
+        if (next_unit(&state) < settings->capitals)
+            word[0] = (unsigned char) (word[0] & ~32u);
+
+        fwrite(word, 1, len, text_file);
+
+        uint64_t separator = next_random(&state) % 16;
+        if (i + 1 == settings->words || separator == 0)
+            fputs(".\n", text_file);
+        else if (separator == 1)
+            fputs(", ", text_file);
+        else
+            fputc(' ', text_file);
+    }
+
+    bool is_written = fclose(wb_file) == 0;
+    is_written = fclose(text_file) == 0 && is_written;
+    free(set.data);
+    free(set.table);
+    free(offsets);
+    free(cdf);
+
+    if (!is_written) {
+        fprintf(stderr, "Error: could not write %s and %s!\n", wb_path, text_path);
+        return 2;
+    }
+
+    return 0;
+}
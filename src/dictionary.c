@@ -0,0 +1,1581 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      // fclose, fgets, fopen, fread, fwrite, remove, rename, sscanf, vsnprintf
+#include <stdarg.h>     // va_list, va_start, va_end
+#include <stdbool.h>    // bool
+#include <stdint.h>     // uint8_t, uint32_t, uint64_t, uintptr_t
+#include <stdlib.h>     // calloc, malloc, realloc, free
+#include <string.h>     // memchr, memcmp, memcpy, memset, strlen
+#include <errno.h>      // errno, EINTR
+#include <pthread.h>    // pthread_create, pthread_join, pthread_mutex_*
+#include <fcntl.h>      // open
+#include <sys/mman.h>   // madvise, mmap, munmap
+#include <sys/stat.h>   // fstat, stat
+#include <unistd.h>     // close, read, sysconf
+
+#if !defined(LOESUNG_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>  // _mm_cmpeq_epi8, _mm_loadu_si128, _mm_movemask_epi8, _mm_set1_epi8
+#endif
+
+#include "loesung_internal.h"
+
+/**
+ * The dictionary of the library: reading the wb.file into the hash table, compiling it to an image and mapping an
+ * image. Errors are not printed, the message is stored in the dictionary and a status is returned. Whatever was loaded
+ * is freed on an error, so the dictionary is empty again.
+ */
+
+/* Function prototypes for reading the wb.file. */
+int map_wb_file(struct Loesung_dictionary *, const char *);
+ssize_t read_wb_file(int, unsigned char *, size_t);
+size_t find_wb_shard_start(const struct WB_file *, size_t);
+void *count_wb_shard_lines(void *);
+void *read_wb_shard(void *);
+void run_wb_shards(struct WB_shard *, long, void *(*)(void *));
+int build_wb_dictionary(struct Loesung_dictionary *, long);
+
+/* Function prototypes for the huge pages. */
+void add_huge_page_stats(const struct Huge_region *, struct Loesung_table_stats *);
+
+/* Function prototypes for the hash functions. */
+uint64_t hash_word_with(int, const unsigned char *, size_t);
+uint64_t djb2_hash(const unsigned char *, size_t);
+uint64_t fnv1a_hash(const unsigned char *, size_t);
+uint64_t wyhash_hash(const unsigned char *, size_t);
+
+/* Function prototypes for the dictionary hash table. */
+void delete_ht_dictionary(struct Loesung_dictionary *);
+struct HT_dictionary *rehash_ht_dictionary(const struct HT_dictionary *, int);
+uint64_t ht_dictionary_memory(const struct Loesung_dictionary *);
+void ht_dictionary_stats(const struct HT_dictionary *, int, struct Loesung_table_stats *);
+const unsigned char *search_in_ht_dictionary(const struct HT_dictionary *, const unsigned char *, size_t, uint64_t,
+                                             uint64_t);
+void prefetch_in_ht_dictionary(const struct HT_dictionary *, const uint64_t *, size_t);
+bool equals_folded(const unsigned char *, const unsigned char *, size_t);
+const unsigned char *search_in_layer(const struct Loesung_dictionary *, const unsigned char *, size_t, uint64_t,
+                                     uint64_t, size_t *);
+
+/* Function prototypes for the dictionary image. */
+uint64_t wbi_hash(const unsigned char *, size_t, uint64_t);
+uint64_t wbi_checksum(const unsigned char *, size_t);
+int compile_wbi_image(struct Loesung_dictionary *, const char *);
+int place_wbi_buckets(const uint64_t *, uint64_t, uint64_t, uint32_t *, uint64_t *);
+int write_wbi_image(const unsigned char *, size_t, const char *);
+int map_wbi_image(struct Loesung_dictionary *, const char *);
+void unmap_wbi_image(struct WBI_image *);
+const unsigned char *search_in_wbi_image(const struct WBI_image *, const unsigned char *, size_t, size_t *);
+
+/* Functions of the library interface. */
+/* Create an empty dictionary. Returns NULL if there is not enough memory. */
+struct Loesung_dictionary *loesung_create_dictionary(void) {
+    return calloc(1, sizeof(struct Loesung_dictionary));
+}
+
+/* Delete a dictionary with everything loaded into it and all layers below it. All translations it returned become
+ * invalid. */
+void loesung_delete_dictionary(struct Loesung_dictionary *dict) {
+    while (dict != NULL) {
+        struct Loesung_dictionary *base = dict->base;
+
+        clear_dictionary(dict);
+        free(dict->error);
+        free(dict);
+        dict = base;
+    }
+}
+
+/* Put base below a dictionary: the words which are not in the dictionary are looked up in base and its layers. base
+ * belongs to the dictionary from now on, the layers which were below it before are deleted. base must not be the
+ * dictionary itself or lie on top of it. */
+void loesung_set_base(struct Loesung_dictionary *dict, struct Loesung_dictionary *base) {
+    loesung_delete_dictionary(dict->base);
+    dict->base = base;
+}
+
+/* Return the layer below a dictionary or NULL if it is the last one. */
+const struct Loesung_dictionary *loesung_base(const struct Loesung_dictionary *dict) {
+    return dict->base;
+}
+
+/* Ask for huge pages for the wb.file, the hash table and the trie of the dictionary from the next load on, so their
+ * random accesses miss the TLB less often. The huge page pool is used if there is one, otherwise transparent huge
+ * pages are asked for. If the system has neither, the memory is the same as without. */
+void loesung_set_huge_pages(struct Loesung_dictionary *dict, bool use_huge_pages) {
+    dict->use_huge_pages = use_huge_pages;
+}
+
+/* Return the message of the last error of the dictionary, or an empty string. */
+const char *loesung_error(const struct Loesung_dictionary *dict) {
+    return dict->error != NULL ? dict->error : "";
+}
+
+/* Load a wb.file or an image into the dictionary, whatever is loaded already is replaced. An image was already
+ * validated when it was compiled, so it only needs to be mapped. Otherwise the wb.file is read and the hash table is
+ * built with the given number of threads. */
+int loesung_load(struct Loesung_dictionary *dict, const char *path, long threads) {
+    if (loesung_is_image(path))
+        return loesung_map_image(dict, path);
+
+    int ret = loesung_read_wb_file(dict, path);
+    return ret == LOESUNG_OK ? loesung_build_table(dict, threads) : ret;
+}
+
+/* Read a wb.file into the dictionary, that's the first half of loading it. The hash table is built afterwards with
+ * loesung_build_table(). */
+int loesung_read_wb_file(struct Loesung_dictionary *dict, const char *path) {
+    clear_dictionary(dict);
+    return map_wb_file(dict, path);
+}
+
+/* Build the hash table from the wb.file which was read into the dictionary. */
+int loesung_build_table(struct Loesung_dictionary *dict, long threads) {
+    if (threads < 1)
+        threads = 1;
+    if (threads > LOESUNG_MAX_THREADS)
+        threads = LOESUNG_MAX_THREADS;
+
+    return build_wb_dictionary(dict, threads);
+}
+
+/* Replace the hash table of the dictionary by a trie, which needs less memory if the words have a lot in common. The
+ * wb.file was checked when the hash table was built, and the trie keeps a copy of all strings it needs, so the hash
+ * table and the wb.file are freed. On an error the dictionary is empty. */
+int loesung_build_trie(struct Loesung_dictionary *dict) {
+    if (dict->table == NULL)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: could not build trie - no wb-file loaded!");
+
+    int ret = build_trie(&dict->trie, dict->table, dict->entries, dict->use_huge_pages);
+    if (ret == LOESUNG_WRONG_FORMAT) {
+        clear_dictionary(dict);
+        return set_error(dict, ret, "Error: could not build trie - too many entries!");
+    }
+    if (ret != LOESUNG_OK) {
+        clear_dictionary(dict);
+        return set_error(dict, ret, "Error: could not build trie - out of memory!");
+    }
+
+    delete_ht_dictionary(dict);
+    return LOESUNG_OK;
+}
+
+/* Map a dictionary image into the dictionary. */
+int loesung_map_image(struct Loesung_dictionary *dict, const char *path) {
+    clear_dictionary(dict);
+    return map_wbi_image(dict, path);
+}
+
+/* Compile the hash table of the dictionary to an image. The dictionary must be loaded from a wb.file. */
+int loesung_compile_image(struct Loesung_dictionary *dict, const char *image_path) {
+    if (dict->table == NULL)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: could not compile dictionary - no wb-file loaded!");
+
+    return compile_wbi_image(dict, image_path);
+}
+
+/* Check the checksum of a dictionary image. This reads the whole image, so it is not done on every start. The image
+ * is mapped into the dictionary for the check and unmapped again. */
+int loesung_check_image(struct Loesung_dictionary *dict, const char *path) {
+    if (!loesung_is_image(path))
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: wrong dictionary image format in %s!", path);
+
+    int ret = loesung_map_image(dict, path);
+    if (ret != LOESUNG_OK)
+        return ret;
+
+    const unsigned char *data = (const unsigned char *) dict->image.header;
+    bool valid = wbi_checksum(data + sizeof(struct WBI_header), dict->image.map_size - sizeof(struct WBI_header)) ==
+                 dict->image.header->checksum;
+    clear_dictionary(dict);
+
+    if (!valid)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: dictionary image %s is corrupt!", path);
+    return LOESUNG_OK;
+}
+
+/* Return the number of entries of the dictionary, without the layers below it. */
+uint64_t loesung_entries(const struct Loesung_dictionary *dict) {
+    return dict->entries;
+}
+
+/* Look up a word of len letters in any case. Returns its translation in lowercase or NULL if it is not in the
+ * dictionary. */
+const char *loesung_lookup(const struct Loesung_dictionary *dict, const char *word, size_t len) {
+    uint64_t hash = hash_word((const unsigned char *) word, len);
+    size_t translation_len;
+
+    return (const char *) search_in_dictionary(dict, (const unsigned char *) word, len, hash, &translation_len);
+}
+
+/* Look up count words at once and store their translations, or NULL, in translations. Returns the number of words
+ * which were found. The words are hashed and their lookups prefetched up to LOESUNG_MAX_BATCH_SIZE at a time before
+ * any of them is searched, so the cache misses of a big hash table overlap. Fewer words per call make smaller
+ * batches. */
+size_t loesung_lookup_batch(const struct Loesung_dictionary *dict, const struct Loesung_token *tokens, size_t count,
+                            const char **translations) {
+    uint64_t hashes[LOESUNG_MAX_BATCH_SIZE];
+    size_t translation_len;
+    size_t found = 0;
+
+    for (size_t first = 0; first < count; first += LOESUNG_MAX_BATCH_SIZE) {
+        size_t batch = count - first < LOESUNG_MAX_BATCH_SIZE ? count - first : LOESUNG_MAX_BATCH_SIZE;
+        const struct Loesung_token *batch_tokens = tokens + first;
+
+        for (size_t i = 0; i < batch; i++)
+            hashes[i] = hash_word((const unsigned char *) batch_tokens[i].word, batch_tokens[i].len);
+
+        if (batch > 1)
+            prefetch_in_dictionary(dict, hashes, batch);
+
+        for (size_t i = 0; i < batch; i++) {
+            translations[first + i] = (const char *) search_in_dictionary(
+                    dict, (const unsigned char *) batch_tokens[i].word, batch_tokens[i].len, hashes[i],
+                    &translation_len);
+            found += translations[first + i] != NULL;
+        }
+    }
+
+    return found;
+}
+
+/* Work out the probes and the clusters of the dictionary, without the layers below it. An image has a perfect hash,
+ * the hash table is walked through once. The probes of a word in a trie are the nodes on the way to it. */
+void loesung_table_stats(const struct Loesung_dictionary *dict, struct Loesung_table_stats *table) {
+    memset(table, 0, sizeof(struct Loesung_table_stats));
+
+    // The trie takes the place of the hash table and the wb.file, so no region is counted twice.
+    add_huge_page_stats(&dict->trie.huge, table);
+    if (dict->table != NULL)
+        add_huge_page_stats(&dict->table->huge, table);
+    add_huge_page_stats(&dict->wb_file.huge, table);
+
+    if (dict->image.header != NULL) {
+        // The perfect hash of the image needs a single probe for every word.
+        table->is_image = true;
+        table->entries = table->slots = dict->image.header->entry_count;
+        table->memory = dict->image.map_size;
+        table->probe_histogram[0] = table->entries;
+        table->longest_probe = table->entries > 0 ? 1 : 0;
+        table->mean_probes_hit = table->mean_probes_miss = 1;
+        return;
+    }
+
+    if (dict->trie.nodes != NULL) {
+        trie_stats(&dict->trie, table);
+        return;
+    }
+
+    if (dict->table == NULL)
+        return;
+
+    ht_dictionary_stats(dict->table, LOESUNG_HASH, table);
+    table->memory = ht_dictionary_memory(dict);
+    table->profile_entries = dict->profile_entries;
+}
+
+/* Return the name of a hash function, or NULL if there is no such hash function. */
+const char *loesung_hash_name(int hash) {
+    static const char *const names[LOESUNG_HASH_COUNT] = {"djb2", "fnv1a", "wyhash"};
+
+    return hash >= 0 && hash < LOESUNG_HASH_COUNT ? names[hash] : NULL;
+}
+
+/* Work out the statistics the hash table of the dictionary would have with another hash function. The entries are
+ * inserted to a table of the same size with this hash function, so the hash functions can be compared on the same
+ * words. The dictionary must be loaded from a wb.file. */
+int loesung_hash_stats(struct Loesung_dictionary *dict, int hash, struct Loesung_table_stats *table) {
+    memset(table, 0, sizeof(struct Loesung_table_stats));
+
+    if (loesung_hash_name(hash) == NULL)
+        return set_error(dict, LOESUNG_INVALID_INPUT, "Error: unknown hash function %d!", hash);
+    if (dict->table == NULL)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: could not hash dictionary - no wb-file loaded!");
+
+    if (hash == LOESUNG_HASH) {
+        loesung_table_stats(dict, table);
+        return LOESUNG_OK;
+    }
+
+    struct HT_dictionary *ht = rehash_ht_dictionary(dict->table, hash);
+    if (ht == NULL)
+        return set_error(dict, LOESUNG_NO_MEMORY, "Error: could not hash dictionary - out of memory!");
+
+    ht_dictionary_stats(ht, hash, table);
+    table->memory = ht_dictionary_memory(dict);
+
+    free_ht_storage(ht);
+    free(ht);
+    return LOESUNG_OK;
+}
+
+/* Put a dictionary in service. It belongs to the service from now on, unless there is not enough memory: then NULL is
+ * returned and the dictionary stays with the caller. */
+struct Loesung_service *loesung_create_service(struct Loesung_dictionary *dict) {
+    struct Loesung_service *service = malloc(sizeof(struct Loesung_service));
+    if (service == NULL)
+        return NULL;
+
+    if (pthread_mutex_init(&service->mutex, NULL) != 0) {
+        free(service);
+        return NULL;
+    }
+    service->dict = dict;
+    service->generation = 0;
+    return service;
+}
+
+/* Delete a service with its dictionary. Nobody may use the service or a dictionary acquired from it anymore. */
+void loesung_delete_service(struct Loesung_service *service) {
+    if (service == NULL)
+        return;
+
+    loesung_delete_dictionary(service->dict);
+    pthread_mutex_destroy(&service->mutex);
+    free(service);
+}
+
+/* Put another dictionary in service, it belongs to the service from now on. Translators of the service switch to it
+ * at their next chunk. The old dictionary is deleted right away if nobody acquired it, otherwise by the last
+ * loesung_release_dictionary(). */
+void loesung_replace_dictionary(struct Loesung_service *service, struct Loesung_dictionary *dict) {
+    pthread_mutex_lock(&service->mutex);
+    struct Loesung_dictionary *old = service->dict;
+    service->dict = dict;
+    service->generation++;
+    bool is_unused = old->users == 0;
+    pthread_mutex_unlock(&service->mutex);
+
+    if (is_unused)
+        loesung_delete_dictionary(old);
+}
+
+/* Acquire the dictionary in service. It stays valid until it is released, even if it is replaced in the meantime. */
+const struct Loesung_dictionary *loesung_acquire_dictionary(struct Loesung_service *service) {
+    uint64_t generation;
+    return acquire_dictionary(service, &generation);
+}
+
+/* Release a dictionary acquired from the service. The last user of a replaced dictionary deletes it. */
+void loesung_release_dictionary(struct Loesung_service *service, const struct Loesung_dictionary *dict) {
+    // The users only read the dictionary, but it belongs to the service, which may delete it.
+    struct Loesung_dictionary *used = (struct Loesung_dictionary *) dict;
+
+    pthread_mutex_lock(&service->mutex);
+    bool is_retired = --used->users == 0 && used != service->dict;
+    pthread_mutex_unlock(&service->mutex);
+
+    if (is_retired)
+        loesung_delete_dictionary(used);
+}
+
+/* Functions for the dictionaries in service. */
+/* Acquire the dictionary in service and return the generation of the service along with it. */
+const struct Loesung_dictionary *acquire_dictionary(struct Loesung_service *service, uint64_t *generation) {
+    pthread_mutex_lock(&service->mutex);
+    struct Loesung_dictionary *dict = service->dict;
+    dict->users++;
+    *generation = service->generation;
+    pthread_mutex_unlock(&service->mutex);
+    return dict;
+}
+
+/* Functions for the errors. */
+/* Store the message of an error in the dictionary and return status. If there is not enough memory for the message,
+ * the dictionary keeps none. */
+int set_error(struct Loesung_dictionary *dict, int status, const char *format, ...) {
+    va_list args;
+
+    va_start(args, format);
+    int len = vsnprintf(NULL, 0, format, args);
+    va_end(args);
+
+    free(dict->error);
+    dict->error = len >= 0 ? malloc((size_t) len + 1) : NULL;
+
+    if (dict->error != NULL) {
+        va_start(args, format);
+        vsnprintf(dict->error, (size_t) len + 1, format, args);
+        va_end(args);
+    }
+
+    return status;
+}
+
+/* Free whatever is loaded into the dictionary. */
+void clear_dictionary(struct Loesung_dictionary *dict) {
+    if (dict->image.header != NULL)
+        unmap_wbi_image(&dict->image);
+    delete_ht_dictionary(dict);
+    delete_trie(&dict->trie);
+    dict->entries = 0;
+    dict->profile_entries = 0;
+}
+
+/* Functions for reading the wb.file. */
+/* Map the wb.file into memory. Regular files are mmap()ed privately, so the parser can split the lines in place.
+ * Everything else (pipes, devices) is read into a buffer instead. Either way there is at least one spare byte behind
+ * the file content, so a last line without a line break can be terminated in place, too. */
+int map_wb_file(struct Loesung_dictionary *dict, const char *path) {
+    struct stat file_stat;
+    int fd;
+
+    // Open file in read-only-mode.
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &file_stat) == -1) {
+        if (fd != -1)
+            close(fd);
+        return set_error(dict, LOESUNG_IO_ERROR, "Error opening file %s!", path);
+    }
+
+    if (S_ISREG(file_stat.st_mode)) {
+        // An empty file is a valid (empty) dictionary, but it can't be mapped.
+        if (file_stat.st_size == 0) {
+            close(fd);
+            return LOESUNG_OK;
+        }
+
+        // With huge pages the file is read into a region of its own, the pages of a mapped file are always small.
+        size_t size = (size_t) file_stat.st_size;
+        if (dict->use_huge_pages && map_huge_region(&dict->wb_file.huge, size + 1)) {
+            ssize_t filled = read_wb_file(fd, dict->wb_file.huge.data, size);
+            close(fd);
+
+            if (filled != (ssize_t) size) {
+                unmap_huge_region(&dict->wb_file.huge);
+                return set_error(dict, LOESUNG_IO_ERROR, "Error - could not create dictionary - wrong input!");
+            }
+            dict->wb_file.data = dict->wb_file.huge.data;
+            dict->wb_file.size = size;
+            return LOESUNG_OK;
+        }
+
+        // Reserve the file size plus the spare byte, rounded up to whole pages. The anonymous pages are zero-filled
+        // and then the file is mapped over them.
+        size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+        size_t map_size = (size + 1 + page_size - 1) / page_size * page_size;
+        unsigned char *data = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (data == MAP_FAILED ||
+            mmap(data, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED | MAP_POPULATE, fd, 0) == MAP_FAILED) {
+            if (data != MAP_FAILED)
+                munmap(data, map_size);
+            close(fd);
+            return set_error(dict, LOESUNG_NO_MEMORY, "Error: could not start to read wb-file - out of memory!");
+        }
+        close(fd);
+
+        dict->wb_file.data = data;
+        dict->wb_file.size = size;
+        dict->wb_file.map_size = map_size;
+        return LOESUNG_OK;
+    }
+
+    // Not a regular file, so read it in blocks and double the buffer if it gets too small.
+    size_t size = 0;
+    size_t size_buffer = 1u << 16u;
+    unsigned char *data = malloc(size_buffer);
+
+    while (data != NULL) {
+        ssize_t bytes_read = read(fd, data + size, size_buffer - size - 1);
+
+        if (bytes_read == 0)
+            break;
+        if (bytes_read < 0) {
+            if (errno == EINTR)
+                continue;
+            free(data);
+            close(fd);
+            return set_error(dict, LOESUNG_IO_ERROR, "Error - could not create dictionary - wrong input!");
+        }
+
+        size += (size_t) bytes_read;
+        if (size + 1 == size_buffer) {
+            unsigned char *tmp = realloc(data, size_buffer *= 2);
+            if (!tmp)
+                free(data);
+            data = tmp;
+        }
+    }
+    close(fd);
+
+    if (data == NULL)
+        return set_error(dict, LOESUNG_NO_MEMORY, "Error: could not read wb-file - out of memory!");
+
+    dict->wb_file.data = data;
+    dict->wb_file.size = size;
+    return LOESUNG_OK;
+}
+
+/* Read size bytes of a regular file from fd into data. Returns the number of bytes read, less only if the file is
+ * shorter, or -1 on a read error. */
+ssize_t read_wb_file(int fd, unsigned char *data, size_t size) {
+    size_t filled = 0;
+
+    while (filled < size) {
+        ssize_t bytes_read = read(fd, data + filled, size - filled);
+
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read < 0)
+            return -1;
+        if (bytes_read == 0)
+            break;
+
+        filled += (size_t) bytes_read;
+    }
+
+    return (ssize_t) filled;
+}
+
+/* Unmap or free the memory of the wb.file. All words and translations become invalid afterwards. */
+void unmap_wb_file(struct WB_file *wb_file) {
+    if (wb_file->huge.data != NULL)
+        unmap_huge_region(&wb_file->huge);
+    else if (wb_file->map_size > 0)
+        munmap(wb_file->data, wb_file->map_size);
+    else
+        free(wb_file->data);
+
+    wb_file->data = NULL;
+    wb_file->size = wb_file->map_size = 0;
+}
+
+/* Find the start of the shard behind offset: the first line behind a line break which ends a word-translation-pair
+ * for sure. That's the case if the line in front of it has a colon which is not right in front of the line break (or
+ * the file has a format error before, which the previous shard reports). Other line breaks might belong to a word or
+ * translation. Returns the size of the file if there is no such line break. */
+size_t find_wb_shard_start(const struct WB_file *wb_file, size_t offset) {
+    const unsigned char *data = wb_file->data;
+    bool has_colon = false;
+
+    // Skip the rest of the line offset is in, we don't know where it started.
+    while (offset < wb_file->size && data[offset] != '\n')
+        offset++;
+
+    for (offset++; offset < wb_file->size; offset++) {
+        if (data[offset] == ':')
+            has_colon = offset + 1 < wb_file->size && data[offset + 1] != '\n';
+        else if (data[offset] == '\n') {
+            if (has_colon)
+                return offset + 1;
+            has_colon = false;
+        }
+    }
+
+    return wb_file->size;
+}
+
+/* Count the lines of a shard. A last line without a line break counts, too. Every word-translation-pair takes at
+ * least one line, so this is an upper bound for the entries of the shard. */
+void *count_wb_shard_lines(void *arg) {
+    struct WB_shard *shard = arg;
+    const unsigned char *cur = shard->begin;
+    uint64_t lines = 0;
+
+    while (cur < shard->end && (cur = memchr(cur, '\n', (size_t) (shard->end - cur))) != NULL) {
+        lines++;
+        cur++;
+    }
+
+    if (shard->end > shard->begin && shard->end[-1] != '\n')
+        lines++;
+
+    shard->max_lines = lines;
+    return NULL;
+}
+
+/* Read the word-translation-pairs of a shard and insert them to the dictionary. The shard is validated and split in
+ * place: the colon and the line break of every pair are overwritten with terminating NULL-characters and the slots
+ * point straight into the mapped bytes. Stops at the first format error. */
+void *read_wb_shard(void *arg) {
+    struct WB_shard *shard = arg;
+    unsigned char *word = shard->begin;     // Start of the word we read.
+    unsigned char *colon = NULL;            // To remember if there already was a colon in the line and where.
+
+    // Behind the last shard we check if we read a line. The spare byte behind the file terminates the translation if
+    // the file has no line break at the end.
+    for (unsigned char *cur = shard->begin; cur <= shard->end; cur++) {
+        unsigned char c = cur < shard->end ? *cur : '\n';
+
+        // Check for valid chars and if there already was a colon in the line.
+        if (((c < 'a' || c > 'z') && c != ':' && c != '\n') || (c == ':' && colon != NULL)) {
+            shard->is_wrong_format = true;
+            return NULL;
+        }
+
+        if (c == ':')
+            // Notice first colon.
+            colon = cur;
+        else if (c == '\n' && colon != NULL && cur > colon + 1) {
+            // If a newline appears and word-translation-pair was read, terminate both strings and insert it to the
+            // dictionary. A newline without a colon or directly after it belongs to the word or translation.
+            *colon = '\0';
+            *cur = '\0';
+
+            shard->entries++;
+
+            // Remember duplicates, but report them after the whole file is checked for format errors.
+            size_t len = (size_t) (colon - word);
+            const unsigned char *old_word = insert_to_ht_dictionary(shard->table, word, len, hash_word(word, len));
+            if (old_word != NULL && old_word > shard->duplicate)
+                shard->duplicate = old_word;
+
+            word = cur + 1;
+            colon = NULL;
+        }
+    }
+
+    return NULL;
+}
+
+/* Run a function for every shard, with a thread each if there is more than one. */
+void run_wb_shards(struct WB_shard *shards, long shard_count, void *(*function)(void *)) {
+    pthread_t threads[LOESUNG_MAX_THREADS];
+    long started = 0;
+
+    while (shard_count > 1 && started < shard_count &&
+           pthread_create(&threads[started], NULL, function, &shards[started]) == 0)
+        started++;
+
+    // Whatever could not get a thread of its own is done right here.
+    for (long i = started; i < shard_count; i++)
+        function(&shards[i]);
+    for (long i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+}
+
+/* Build the dictionary from the mapped wb.file. The file is cut into a shard per thread at line breaks which end a
+ * word-translation-pair. The shards are read in parallel and inserted to the same hash table. */
+int build_wb_dictionary(struct Loesung_dictionary *dict, long threads) {
+    const struct WB_file *wb_file = &dict->wb_file;
+
+    // Small files are not worth the threads.
+    long shard_count = threads;
+    if ((uint64_t) shard_count > wb_file->size / MIN_SHARD_SIZE)
+        shard_count = wb_file->size / MIN_SHARD_SIZE > 0 ? (long) (wb_file->size / MIN_SHARD_SIZE) : 1;
+
+    struct WB_shard shards[LOESUNG_MAX_THREADS];
+    size_t begin = 0;
+    for (long i = 0; i < shard_count; i++) {
+        size_t end = i + 1 < shard_count ?
+                     find_wb_shard_start(wb_file, wb_file->size / (size_t) shard_count * (size_t) (i + 1)) :
+                     wb_file->size;
+        if (end < begin)
+            end = begin;
+
+        shards[i] = (struct WB_shard) {NULL, wb_file->data + begin, wb_file->data + end, 0, 0, false, NULL};
+        begin = end;
+    }
+
+    // Create a hash table which is big enough for all lines, every entry takes at least one.
+    run_wb_shards(shards, shard_count, count_wb_shard_lines);
+
+    uint64_t max_lines = 0;
+    for (long i = 0; i < shard_count; i++)
+        max_lines += shards[i].max_lines;
+    dict->table = create_new_ht_dictionary(ht_dictionary_size(max_lines), wb_file->data, dict->use_huge_pages);
+
+    if (dict->table == NULL) {
+        delete_ht_dictionary(dict);
+        return set_error(dict, LOESUNG_NO_MEMORY, "Error: could not create dictionary - out of memory!");
+    }
+
+    for (long i = 0; i < shard_count; i++)
+        shards[i].table = dict->table;
+
+    run_wb_shards(shards, shard_count, read_wb_shard);
+
+    // The first shard with a format error has the error with the lowest line number. All shards in front of it were
+    // read completely, so their entries give the line.
+    uint64_t wb_lines = 0;                      // Count of lines we read -> how many entries will our dictionary have.
+    const unsigned char *duplicate = NULL;      // Last word of the file which is repeated further down.
+
+    for (long i = 0; i < shard_count; i++) {
+        if (shards[i].is_wrong_format) {
+            delete_ht_dictionary(dict);
+            return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: wrong dictionary format in line %lu!",
+                             wb_lines + shards[i].entries + 1);
+        }
+
+        wb_lines += shards[i].entries;
+        if (shards[i].duplicate > duplicate)
+            duplicate = shards[i].duplicate;
+    }
+
+    if (duplicate != NULL) {
+        set_error(dict, LOESUNG_WRONG_FORMAT, "Wrong dictionary format, found duplicate: <%s>!", duplicate);
+        delete_ht_dictionary(dict);
+        return LOESUNG_WRONG_FORMAT;
+    }
+
+    dict->entries = wb_lines;
+    return LOESUNG_OK;
+}
+
+/* Functions for the huge pages. */
+/* Map a zero-filled region of at least size bytes for huge pages. The huge page pool is tried first, then a region
+ * which is aligned to a huge page is mapped and transparent huge pages are asked for. Returns false if size is less
+ * than a huge page or nothing can be mapped, the caller takes normal memory then. */
+bool map_huge_region(struct Huge_region *region, size_t size) {
+    size_t map_size = (size + LOESUNG_HUGE_PAGE_SIZE - 1) / LOESUNG_HUGE_PAGE_SIZE * LOESUNG_HUGE_PAGE_SIZE;
+    *region = (struct Huge_region) {NULL, 0, false};
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+    if (size < LOESUNG_HUGE_PAGE_SIZE)
+        return false;
+
+#ifdef MAP_HUGETLB
+    // The pool only has pages if the administrator reserved some.
+    unsigned char *data = mmap(NULL, map_size, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+    if (data != MAP_FAILED) {
+        *region = (struct Huge_region) {data, map_size, true};
+        return true;
+    }
+#endif
+
+    // Map a huge page more than needed and cut off the ends, so the region starts at a huge page.
+    unsigned char *reserved = mmap(NULL, map_size + LOESUNG_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (reserved == MAP_FAILED)
+        return false;
+
+    size_t head = (uintptr_t) reserved % LOESUNG_HUGE_PAGE_SIZE;
+    head = head > 0 ? LOESUNG_HUGE_PAGE_SIZE - head : 0;
+    if (head > 0)
+        munmap(reserved, head);
+    munmap(reserved + head + map_size, LOESUNG_HUGE_PAGE_SIZE - head);
+
+#ifdef MADV_HUGEPAGE
+    madvise(reserved + head, map_size, MADV_HUGEPAGE);
+#endif
+    *region = (struct Huge_region) {reserved + head, map_size, false};
+    return true;
+}
+
+/* Unmap a region for huge pages. */
+void unmap_huge_region(struct Huge_region *region) {
+    if (region->data != NULL)
+        munmap(region->data, region->size);
+    *region = (struct Huge_region) {NULL, 0, false};
+}
+
+/* Count the huge pages which back a region. Pages of the pool are all huge, for transparent huge pages the kernel
+ * tells in /proc/self/smaps. A mapping there may also span memory next to the region, its huge pages are shared out by
+ * the part which overlaps the region. Returns 0 if the system can't tell. */
+uint64_t count_huge_pages(const struct Huge_region *region) {
+    if (region->data == NULL)
+        return 0;
+    if (region->is_hugetlb)
+        return region->size / LOESUNG_HUGE_PAGE_SIZE;
+
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    if (smaps == NULL)
+        return 0;
+
+    uintptr_t region_start = (uintptr_t) region->data;
+    uintptr_t region_end = region_start + region->size;
+    unsigned long start = 0;
+    unsigned long end = 0;
+    unsigned long huge_kb;
+    uint64_t huge_bytes = 0;
+    char line[256];
+
+    // Every mapping starts with a line of its addresses, its AnonHugePages line follows.
+    while (fgets(line, sizeof(line), smaps) != NULL) {
+        unsigned long line_start, line_end;
+        if (sscanf(line, "%lx-%lx ", &line_start, &line_end) == 2) {
+            start = line_start;
+            end = line_end;
+        } else if (sscanf(line, "AnonHugePages: %lu kB", &huge_kb) == 1 && start < region_end && end > region_start) {
+            uintptr_t overlap = (end < region_end ? end : region_end) - (start > region_start ? start : region_start);
+            huge_bytes += (uint64_t) ((double) huge_kb * 1024 * (double) overlap / (double) (end - start));
+        }
+    }
+
+    fclose(smaps);
+    return huge_bytes / LOESUNG_HUGE_PAGE_SIZE;
+}
+
+/* Add the memory of a region to the huge page statistics of a dictionary. */
+void add_huge_page_stats(const struct Huge_region *region, struct Loesung_table_stats *table) {
+    if (region->data == NULL)
+        return;
+
+    table->huge_memory += region->size;
+    table->huge_pages += count_huge_pages(region);
+    table->is_hugetlb = table->is_hugetlb || region->is_hugetlb;
+}
+
+/* Functions for the hash functions. All of them fold the letters to lowercase, so the words of a text are hashed as
+ * is. */
+/* Hash a word of len letters with the hash function of the hash table. */
+uint64_t hash_word(const unsigned char *word, size_t len) {
+    return hash_word_with(LOESUNG_HASH, word, len);
+}
+
+/* Hash a word of len letters with the given hash function. */
+uint64_t hash_word_with(int hash, const unsigned char *word, size_t len) {
+    if (hash == LOESUNG_HASH_DJB2)
+        return djb2_hash(word, len);
+    if (hash == LOESUNG_HASH_FNV1A)
+        return fnv1a_hash(word, len);
+    return wyhash_hash(word, len);
+}
+
+/* Pack a word of len letters in any case into the key of a slot: the letters a-z are 1-26 in five bits each, the last
+ * letter in the lowest bits. No letter is zero, so a word of up to HT_KEY_LETTERS letters is told apart from every
+ * other by its key alone. A longer word keeps its first HT_KEY_LONG_LETTERS letters, its length up to
+ * HT_KEY_LONG_LENGTH in the low eight bits and HT_KEY_LONG. */
+uint64_t pack_word(const unsigned char *word, size_t len) {
+    size_t packed = len <= HT_KEY_LETTERS ? len : HT_KEY_LONG_LETTERS;
+    uint64_t key = 0;
+
+    for (size_t i = 0; i < packed; i++)
+        key = key << 5u | (word[i] & 31u);
+
+    if (len > HT_KEY_LETTERS)
+        key = HT_KEY_LONG | key << 8u | (len < HT_KEY_LONG_LENGTH ? len : HT_KEY_LONG_LENGTH);
+    return key;
+}
+
+/* DJB2 hash function for strings. */
+uint64_t djb2_hash(const unsigned char *word, size_t len) {
+    uint64_t hash = DJB2_INIT;
+
+    for (size_t i = 0; i < len; i++)
+        hash = DJB2_STEP(hash, word[i] | 32u);
+
+    return hash;
+}
+
+/* FNV-1a hash function for strings. */
+uint64_t fnv1a_hash(const unsigned char *word, size_t len) {
+    uint64_t hash = FNV1A_INIT;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (word[i] | 32u)) * FNV1A_PRIME;
+
+    return hash;
+}
+
+/* Hash function in the style of wyhash: eight letters at a time are multiplied into the hash with a 128 bit product
+ * and the halves of the product are folded. The last one to seven letters are padded with zeros and the length goes
+ * into the hash at the end, so the hash of a word can be built up while its end is not known yet. */
+uint64_t wyhash_hash(const unsigned char *word, size_t len) {
+    uint64_t hash = WYHASH_INIT;
+    uint64_t chunk;
+    size_t i = 0;
+
+    for (; i + 8 <= len; i += 8) {
+        memcpy(&chunk, word + i, 8);
+        hash = WYHASH_STEP(hash, chunk);
+    }
+
+    if (i < len) {
+        chunk = 0;
+        memcpy(&chunk, word + i, len - i);
+        hash = WYHASH_STEP(hash, chunk);
+    }
+
+    return WYHASH_FINISH(hash, len);
+}
+
+/* Functions for dictionary hash table */
+/* Return the smallest size which keeps a table of max_entries at seven eighths at most. It is a power of two of
+ * groups. */
+uint64_t ht_dictionary_size(uint64_t max_entries) {
+    uint64_t groups = 1;
+
+    while (groups * HT_GROUP_SIZE * 7u < max_entries * 8u)
+        groups *= 2;
+
+    return groups * HT_GROUP_SIZE;
+}
+
+/* Create new dictionary of size slots for the words of blob. Returns NULL if there is not enough memory. */
+struct HT_dictionary *create_new_ht_dictionary(uint64_t size, const unsigned char *blob, bool use_huge_pages) {
+    // Allocate memory for the hash table.
+    struct HT_dictionary *ht = malloc(sizeof(struct HT_dictionary));
+
+    if (ht == NULL)
+        return NULL;
+
+    // Set the desired size and allocate the control bytes, which are all HT_EMPTY, and the slots. With huge pages both
+    // share a region, the slots follow the control bytes. Anonymous memory is zero-filled.
+    ht->dict_size = size;
+    ht->blob = blob;
+    ht->huge = (struct Huge_region) {NULL, 0, false};
+
+    if (use_huge_pages && map_huge_region(&ht->huge, ht->dict_size * (1 + sizeof(struct HT_slot)))) {
+        ht->ctrl = ht->huge.data;
+        ht->slots = (struct HT_slot *) (ht->huge.data + ht->dict_size);
+        return ht;
+    }
+
+    ht->ctrl = calloc(ht->dict_size, 1);
+    ht->slots = malloc(ht->dict_size * sizeof(struct HT_slot));
+
+    if (ht->ctrl == NULL || ht->slots == NULL) {
+        free_ht_storage(ht);
+        free(ht);
+        return NULL;
+    }
+
+    return ht;
+}
+
+/* Free the control bytes and the slots of the hash table. */
+void free_ht_storage(struct HT_dictionary *table) {
+    if (table->huge.data != NULL)
+        unmap_huge_region(&table->huge);
+    else {
+        free(table->ctrl);
+        free(table->slots);
+    }
+
+    table->ctrl = NULL;
+    table->slots = NULL;
+    table->dict_size = 0;
+}
+
+/* Delete the hash table. The strings go with the wb.file. */
+void delete_ht_dictionary(struct Loesung_dictionary *dict) {
+    if (dict->table != NULL) {
+        free_ht_storage(dict->table);
+        free(dict->table);
+        dict->table = NULL;
+    }
+    unmap_wb_file(&dict->wb_file);
+}
+
+/* Insert all entries of a hash table to a new one of the same size with another hash function. Returns NULL if there is
+ * not enough memory. */
+struct HT_dictionary *rehash_ht_dictionary(const struct HT_dictionary *table, int hash) {
+    struct HT_dictionary *ht = create_new_ht_dictionary(table->dict_size, table->blob, false);
+
+    if (ht == NULL)
+        return NULL;
+
+    for (uint64_t i = 0; i < table->dict_size; i++) {
+        if (!(table->ctrl[i] & HT_FULL))
+            continue;
+
+        const unsigned char *word = table->blob + table->slots[i].offset;
+        uint64_t length = ht_slot_length(table, &table->slots[i]);
+        insert_to_ht_dictionary(ht, word, length, hash_word_with(hash, word, length));
+    }
+
+    return ht;
+}
+
+/* Return the memory of the hash table and the wb.file of the dictionary. */
+uint64_t ht_dictionary_memory(const struct Loesung_dictionary *dict) {
+    return sizeof(struct HT_dictionary) + dict->table->dict_size * (1 + sizeof(struct HT_slot)) +
+           (dict->wb_file.map_size > 0 ? dict->wb_file.map_size : dict->wb_file.size);
+}
+
+/* Walk through a hash table with the given hash function once and work out the probed groups of every word, the used
+ * slots of every group and the clusters. A search for a word which is not in the table starts at any group and probes
+ * up to the next one with a free slot, so its mean is taken over all groups. */
+void ht_dictionary_stats(const struct HT_dictionary *ht, int hash, struct Loesung_table_stats *table) {
+    uint64_t groups = ht->dict_size / HT_GROUP_SIZE;
+    uint64_t probes_hit = 0;
+    uint64_t probes_miss = 0;
+
+    table->hash = hash;
+    table->slots = ht->dict_size;
+
+    for (uint64_t i = 0; i < ht->dict_size; i++) {
+        if (!(ht->ctrl[i] & HT_FULL))
+            continue;
+
+        const unsigned char *word = ht->blob + ht->slots[i].offset;
+        uint64_t length = ht_slot_length(ht, &ht->slots[i]);
+        uint64_t probes = probe_ht_groups(ht, hash_word_with(hash, word, length), i / HT_GROUP_SIZE);
+        table->entries++;
+        table->probe_histogram[probes < LOESUNG_PROBE_BUCKETS ? probes - 1 : LOESUNG_PROBE_BUCKETS - 1]++;
+        probes_hit += probes;
+        if (probes > table->longest_probe)
+            table->longest_probe = probes;
+    }
+
+    // A miss stops at the first group with a free slot. There is always one, the table is never full.
+    uint64_t cluster = 0;
+    for (uint64_t group = 0; group < groups; group++) {
+        uint64_t probes = 1;
+        for (uint64_t cur = group; match_ht_group(ht->ctrl + cur * HT_GROUP_SIZE, HT_EMPTY) == 0; probes++)
+            cur = (cur + probes) & (groups - 1);
+        probes_miss += probes;
+
+        uint32_t empty = match_ht_group(ht->ctrl + group * HT_GROUP_SIZE, HT_EMPTY);
+        table->group_histogram[HT_GROUP_SIZE - (uint64_t) __builtin_popcount(empty)]++;
+        cluster = empty == 0 ? cluster + 1 : 0;
+        if (cluster > table->longest_cluster)
+            table->longest_cluster = cluster;
+    }
+
+    table->mean_probes_hit = table->entries > 0 ? (double) probes_hit / (double) table->entries : 0;
+    table->mean_probes_miss = (double) probes_miss / (double) groups;
+}
+
+/* Compare the control bytes of a group to byte. Bit i of the result is set if the control byte of slot i matches. */
+uint32_t match_ht_group(const uint8_t *ctrl, uint8_t byte) {
+#if !defined(LOESUNG_SCALAR) && defined(__SSE2__)
+    __m128i group = _mm_loadu_si128((const __m128i *) ctrl);
+    return (uint32_t) _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8((char) byte)));
+#else
+    uint32_t matches = 0;
+
+    for (uint32_t i = 0; i < HT_GROUP_SIZE; i++)
+        matches |= (uint32_t) (ctrl[i] == byte) << i;
+
+    return matches;
+#endif
+}
+
+/* Return the number of letters of the word of a slot. The key of a short word holds all of them, only a very long word
+ * needs to be measured. */
+uint64_t ht_slot_length(const struct HT_dictionary *table, const struct HT_slot *slot) {
+    if (!(slot->key & HT_KEY_LONG))
+        return slot->key != 0 ? (uint64_t) (68 - __builtin_clzll(slot->key)) / 5 : 0;
+    if ((slot->key & HT_KEY_LONG_LENGTH) < HT_KEY_LONG_LENGTH)
+        return slot->key & HT_KEY_LONG_LENGTH;
+
+    return strlen((const char *) table->blob + slot->offset);
+}
+
+/* Count the groups a search for a word with the hash probes until it reaches target_group. */
+uint64_t probe_ht_groups(const struct HT_dictionary *table, uint64_t hash, uint64_t target_group) {
+    uint64_t mask = table->dict_size / HT_GROUP_SIZE - 1;
+    uint64_t group = (hash >> 7u) & mask;
+    uint64_t probes = 1;
+
+    while (group != target_group)
+        group = (group + probes++) & mask;
+
+    return probes;
+}
+
+/* Insert a new word-translation-pair in the dictionary, the translation follows the word of len letters in the blob.
+ * The hash is computed once, the low seven bits are the tag of the control byte and the next ones pick the group to
+ * start with. The slot gets the packed key of the word. The groups are probed triangular: the step to the next group
+ * grows by one every time, which visits every group of a power of two. Several threads can insert at the same time: a
+ * slot is only taken with compare-and-swap and never becomes empty again, and all threads look at the slots in the same
+ * order. If the word is already in the dictionary, the one which comes later in the file keeps the slot and the other
+ * one is returned. Otherwise NULL is returned. */
+const unsigned char *insert_to_ht_dictionary(struct HT_dictionary *table, const unsigned char *word, size_t len,
+                                             uint64_t hash) {
+    uint64_t mask = table->dict_size / HT_GROUP_SIZE - 1;
+    uint64_t group = (hash >> 7u) & mask;
+    uint64_t offset = (uint64_t) (word - table->blob);
+    uint64_t key = pack_word(word, len);
+    uint8_t tag = (uint8_t) (HT_FULL | (hash & 0x7fu));
+
+    for (uint64_t step = 1; true; step++) {
+        for (uint64_t index = group * HT_GROUP_SIZE; index < (group + 1) * HT_GROUP_SIZE; index++) {
+            uint8_t *ctrl = &table->ctrl[index];
+            struct HT_slot *slot = &table->slots[index];
+            uint8_t cur_ctrl = __atomic_load_n(ctrl, __ATOMIC_ACQUIRE);
+
+            // Take an empty slot, fill it and publish the tag. If another thread was faster, cur_ctrl is its control
+            // byte now.
+            if (cur_ctrl == HT_EMPTY &&
+                __atomic_compare_exchange_n(ctrl, &cur_ctrl, HT_BUSY, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+                *slot = (struct HT_slot) {offset, key};
+                __atomic_store_n(ctrl, tag, __ATOMIC_RELEASE);
+                return NULL;
+            }
+
+            // The slot is being filled, wait for it as it might get the same word.
+            while (cur_ctrl == HT_BUSY)
+                cur_ctrl = __atomic_load_n(ctrl, __ATOMIC_ACQUIRE);
+
+            if (cur_ctrl != tag || slot->key != key)
+                continue;
+
+            // A slot only changes to another offset of the same word, so cur_offset stays a duplicate.
+            uint64_t cur_offset = __atomic_load_n(&slot->offset, __ATOMIC_ACQUIRE);
+            if (equals_ht_key(table->blob + cur_offset, slot->key, word, len, key)) {
+                while (true) {
+                    if (offset < cur_offset)
+                        return word;
+                    if (__atomic_compare_exchange_n(&slot->offset, &cur_offset, offset, false, __ATOMIC_RELEASE,
+                                                    __ATOMIC_ACQUIRE))
+                        return table->blob + cur_offset;
+                }
+            }
+        }
+
+        // All slots of the group are taken by other words, try the next group.
+        group = (group + step) & mask;
+    }
+}
+
+/* Search for a word in the dictionary. This is almost the same as inserting:
+ * Compare the control bytes of the group of the hash to the tag of the word at once and check the slots which match.
+ * If none has the word, try the next group until a match or a group with an empty slot.
+ * The word doesn't need to be lowercase or zero terminated, hash is its hash from hash_word() and key its key from
+ * pack_word(). */
+const unsigned char *search_in_ht_dictionary(const struct HT_dictionary *table, const unsigned char *word, size_t len,
+                                             uint64_t hash, uint64_t key) {
+    uint64_t mask = table->dict_size / HT_GROUP_SIZE - 1;
+    uint64_t group = (hash >> 7u) & mask;
+    uint8_t tag = (uint8_t) (HT_FULL | (hash & 0x7fu));
+
+    for (uint64_t step = 1; true; step++) {
+        const uint8_t *ctrl = table->ctrl + group * HT_GROUP_SIZE;
+
+        for (uint32_t matches = match_ht_group(ctrl, tag); matches != 0; matches &= matches - 1) {
+            const struct HT_slot *slot = &table->slots[group * HT_GROUP_SIZE + (uint64_t) __builtin_ctz(matches)];
+            if (equals_ht_key(table->blob + slot->offset, slot->key, word, len, key))
+                return table->blob + slot->offset + len + 1;
+        }
+
+        if (match_ht_group(ctrl, HT_EMPTY) != 0)
+            return NULL;
+        group = (group + step) & mask;
+    }
+}
+
+/* Prefetch what the searches for count words with the hashes need in three stages, one word after the other in each:
+ * the control bytes of the first group, the slot of the first tag match and its word, which the translation follows.
+ * Every stage reads what the one before has prefetched, by then it has mostly arrived. Only the first group is
+ * prefetched, with a load of seven eighths at most almost every word is found there. A word which is not in the table
+ * rarely gets further than the control bytes. */
+void prefetch_in_ht_dictionary(const struct HT_dictionary *table, const uint64_t *hashes, size_t count) {
+    uint64_t mask = table->dict_size / HT_GROUP_SIZE - 1;
+
+    for (size_t i = 0; i < count; i++)
+        __builtin_prefetch(table->ctrl + ((hashes[i] >> 7u) & mask) * HT_GROUP_SIZE);
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t group = (hashes[i] >> 7u) & mask;
+        uint32_t matches = match_ht_group(table->ctrl + group * HT_GROUP_SIZE,
+                                          (uint8_t) (HT_FULL | (hashes[i] & 0x7fu)));
+        if (matches != 0)
+            __builtin_prefetch(&table->slots[group * HT_GROUP_SIZE + (uint64_t) __builtin_ctz(matches)]);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t group = (hashes[i] >> 7u) & mask;
+        uint32_t matches = match_ht_group(table->ctrl + group * HT_GROUP_SIZE,
+                                          (uint8_t) (HT_FULL | (hashes[i] & 0x7fu)));
+        if (matches == 0)
+            continue;
+
+        const struct HT_slot *slot = &table->slots[group * HT_GROUP_SIZE + (uint64_t) __builtin_ctz(matches)];
+        __builtin_prefetch(table->blob + slot->offset);
+    }
+}
+
+/* Compare a lowercase, zero terminated word of the dictionary to a word of len letters in any case. */
+bool equals_folded(const unsigned char *item_word, const unsigned char *word, size_t len) {
+    // A letter in lowercase is never zero, so this stops at the end of a shorter item_word.
+    for (size_t i = 0; i < len; i++)
+        if (item_word[i] != (word[i] | 32u))
+            return false;
+
+    return item_word[len] == '\0';
+}
+
+/* Compare the word of a slot with its key to a word of len letters in any case with its key. Only the letters of a long
+ * word which are not in the key are compared one by one. */
+bool equals_ht_key(const unsigned char *item_word, uint64_t item_key, const unsigned char *word, size_t len,
+                   uint64_t key) {
+    return item_key == key &&
+           (len <= HT_KEY_LETTERS ||
+            equals_folded(item_word + HT_KEY_LONG_LETTERS, word + HT_KEY_LONG_LETTERS, len - HT_KEY_LONG_LETTERS));
+}
+
+/* Search for a word in the layers of the dictionary from the top, the first translation wins. The word is packed once
+ * for all of them. Sets translation_len to the length of the translation if the word is found, so the output doesn't
+ * need to measure it. */
+const unsigned char *search_in_dictionary(const struct Loesung_dictionary *dict, const unsigned char *word, size_t len,
+                                          uint64_t hash, size_t *translation_len) {
+    uint64_t key = pack_word(word, len);
+    const unsigned char *translation = search_in_layer(dict, word, len, hash, key, translation_len);
+
+    // Fall back to the layers below, the first translation wins.
+    while (translation == NULL && dict->base != NULL) {
+        dict = dict->base;
+        translation = search_in_layer(dict, word, len, hash, key, translation_len);
+    }
+
+    return translation;
+}
+
+/* Search for a word in a single layer, in whichever dictionary is in use. The image has a hash function of its own
+ * and the trie needs none, only the hash table compares keys. An empty layer has no words. The image stores the length
+ * of a translation in the slot, the 16 bytes of a slot of the hash table have no room for it, so a translation found
+ * there is measured. */
+const unsigned char *search_in_layer(const struct Loesung_dictionary *dict, const unsigned char *word, size_t len,
+                                     uint64_t hash, uint64_t key, size_t *translation_len) {
+    if (dict->image.header != NULL)
+        return search_in_wbi_image(&dict->image, word, len, translation_len);
+    if (dict->trie.nodes != NULL)
+        return search_in_trie(&dict->trie, word, len, translation_len);
+    if (dict->table == NULL)
+        return NULL;
+
+    const unsigned char *translation = search_in_ht_dictionary(dict->table, word, len, hash, key);
+    if (translation != NULL)
+        *translation_len = strlen((const char *) translation);
+    return translation;
+}
+
+/* Prefetch the searches for count words with the hashes in every layer of the dictionary. Only hash tables are
+ * prefetched, the image needs a hash of its own and every node of the trie depends on the one before. */
+void prefetch_in_dictionary(const struct Loesung_dictionary *dict, const uint64_t *hashes, size_t count) {
+    // With a small layer on top of a big one most words are looked up in both.
+    for (; dict != NULL; dict = dict->base)
+        if (dict->image.header == NULL && dict->trie.nodes == NULL && dict->table != NULL)
+            prefetch_in_ht_dictionary(dict->table, hashes, count);
+}
+
+/* Functions for the dictionary image. */
+/* Finalizer of MurmurHash3, it spreads every input bit over the whole word. */
+uint64_t mix64(uint64_t x) {
+    x ^= x >> 33u;
+    x *= 0xff51afd7ed558ccdu;
+    x ^= x >> 33u;
+    x *= 0xc4ceb9fe1a85ec53u;
+    x ^= x >> 33u;
+    return x;
+}
+
+/* Seeded FNV-1a hash for the perfect hash of an image. The seed changes if the construction gets stuck. The words of
+ * the dictionary are lowercase anyway, so the letters are folded to lowercase to hash the words of a text as is. */
+uint64_t wbi_hash(const unsigned char *word, size_t len, uint64_t seed) {
+    uint64_t hash = FNV1A_INIT ^ seed;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (word[i] | 32u)) * FNV1A_PRIME;
+
+    return mix64(hash);
+}
+
+/* FNV-1a checksum of an image, eight bytes at a time. */
+uint64_t wbi_checksum(const unsigned char *data, size_t size) {
+    uint64_t checksum = FNV1A_INIT;
+    size_t i = 0;
+
+    for (; i + 8 <= size; i += 8) {
+        uint64_t chunk;
+        memcpy(&chunk, data + i, 8);
+        checksum = (checksum ^ chunk) * FNV1A_PRIME;
+    }
+    for (; i < size; i++)
+        checksum = (checksum ^ data[i]) * FNV1A_PRIME;
+
+    return checksum;
+}
+
+/* Compile the hash table to a dictionary image. The wb.file was read and checked for duplicates exactly like for a
+ * translation, now every word gets its slot from a minimal perfect hash (hash and displace): the words are
+ * distributed to buckets and for every bucket a pilot is searched which moves all of its words to free slots. */
+int compile_wbi_image(struct Loesung_dictionary *dict, const char *image_path) {
+    const struct HT_dictionary *table = dict->table;
+
+    // Collect all entries of the hash table.
+    uint64_t entry_count = 0;
+    for (uint64_t i = 0; i < table->dict_size; i++)
+        if (table->ctrl[i] & HT_FULL)
+            entry_count++;
+
+    if (entry_count >= WBI_DIRECT)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: could not compile dictionary - too many entries!");
+
+    uint64_t bucket_count = entry_count / WBI_BUCKET_LOAD + 1;
+    const struct HT_slot **entries = malloc((entry_count + 1) * sizeof(struct HT_slot *));
+    uint64_t *hashes = malloc((entry_count + 1) * sizeof(uint64_t));
+    uint64_t *slot_entries = malloc((entry_count + 1) * sizeof(uint64_t));
+    uint32_t *pilots = malloc(bucket_count * sizeof(uint32_t));
+    int placed = entries != NULL && hashes != NULL && slot_entries != NULL && pilots != NULL ? 0 : LOESUNG_NO_MEMORY;
+
+    uint64_t blob_size = 0;
+    for (uint64_t i = 0, j = 0; placed == 0 && i < table->dict_size; i++)
+        if (table->ctrl[i] & HT_FULL) {
+            uint64_t length = ht_slot_length(table, &table->slots[i]);
+            entries[j++] = &table->slots[i];
+            blob_size += length + strlen((const char *) table->blob + table->slots[i].offset + length + 1) + 2;
+        }
+
+    // Try seeds until the pilot search succeeds, which usually happens with the first one.
+    uint32_t seed = 0;
+    for (uint32_t attempt = 0; attempt < WBI_SEED_LIMIT && placed == 0; attempt++) {
+        seed = (uint32_t) mix64(attempt + 1);
+        for (uint64_t i = 0; i < entry_count; i++)
+            hashes[i] = wbi_hash(table->blob + entries[i]->offset, ht_slot_length(table, entries[i]), seed);
+        placed = place_wbi_buckets(hashes, entry_count, bucket_count, pilots, slot_entries);
+    }
+
+    // Lay out the image in memory: header, pilots, slots and the blob in slot order.
+    uint64_t pilots_offset = sizeof(struct WBI_header);
+    uint64_t slots_offset = (pilots_offset + bucket_count * sizeof(uint32_t) + 7u) & ~(uint64_t) 7u;
+    uint64_t blob_offset = slots_offset + entry_count * sizeof(struct WBI_slot);
+    size_t image_size = blob_offset + blob_size;
+    unsigned char *image = placed == 1 ? calloc(image_size, 1) : NULL;
+
+    if (image != NULL) {
+        struct WBI_header header = {WBI_MAGIC, WBI_VERSION, seed, entry_count, bucket_count, pilots_offset,
+                                    slots_offset, blob_offset, blob_size, 0};
+        memcpy(image + pilots_offset, pilots, bucket_count * sizeof(uint32_t));
+
+        uint64_t offset = 0;
+        for (uint64_t i = 0; i < entry_count; i++) {
+            const unsigned char *word = table->blob + entries[slot_entries[i]]->offset;
+            uint32_t length = (uint32_t) ht_slot_length(table, entries[slot_entries[i]]);
+            const unsigned char *translation = word + length + 1;
+            struct WBI_slot slot = {offset, length, (uint32_t) strlen((const char *) translation)};
+
+            memcpy(image + slots_offset + i * sizeof(struct WBI_slot), &slot, sizeof(slot));
+            memcpy(image + blob_offset + offset, word, slot.word_length + 1);
+            offset += slot.word_length + 1;
+            memcpy(image + blob_offset + offset, translation, slot.translation_length + 1);
+            offset += slot.translation_length + 1;
+        }
+
+        header.checksum = wbi_checksum(image + sizeof(header), image_size - sizeof(header));
+        memcpy(image, &header, sizeof(header));
+    }
+
+    free(entries);
+    free(hashes);
+    free(slot_entries);
+    free(pilots);
+
+    if (placed == 0)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: could not compile dictionary - no perfect hash found!");
+    if (image == NULL)
+        return set_error(dict, LOESUNG_NO_MEMORY, "Error: could not compile dictionary - out of memory!");
+
+    int ret = write_wbi_image(image, image_size, image_path);
+    free(image);
+
+    if (ret != LOESUNG_OK)
+        return set_error(dict, ret, "Error: could not write dictionary image %s!", image_path);
+    return LOESUNG_OK;
+}
+
+/* Search a pilot for every bucket of the perfect hash, biggest buckets first. The slot of every word is stored in
+ * slot_entries. Buckets with a single word don't need a search, they simply get one of the remaining slots. Returns
+ * 1 if all buckets are placed, 0 if a bucket can't be placed or LOESUNG_NO_MEMORY. */
+int place_wbi_buckets(const uint64_t *hashes, uint64_t entry_count, uint64_t bucket_count, uint32_t *pilots,
+                      uint64_t *slot_entries) {
+    // Sort the entries by bucket and the buckets by size (counting sort both times).
+    uint64_t *bucket_start = calloc(bucket_count + 1, sizeof(uint64_t));
+    uint64_t *bucket_entries = malloc((entry_count + 1) * sizeof(uint64_t));
+    uint64_t *buckets = malloc(bucket_count * sizeof(uint64_t));
+    uint8_t *taken = calloc(entry_count + 1, 1);
+    uint64_t *size_start = NULL;
+    uint64_t max_bucket_size = 0;
+    int placed = bucket_start != NULL && bucket_entries != NULL && buckets != NULL && taken != NULL ? 1 :
+                 LOESUNG_NO_MEMORY;
+
+    if (placed == 1) {
+        for (uint64_t i = 0; i < entry_count; i++)
+            bucket_start[hashes[i] % bucket_count + 1]++;
+        for (uint64_t b = 0; b < bucket_count; b++) {
+            if (bucket_start[b + 1] > max_bucket_size)
+                max_bucket_size = bucket_start[b + 1];
+            bucket_start[b + 1] += bucket_start[b];
+        }
+        for (uint64_t i = 0; i < entry_count; i++)
+            bucket_entries[bucket_start[hashes[i] % bucket_count]++] = i;
+        for (uint64_t b = bucket_count; b > 0; b--)
+            bucket_start[b] = bucket_start[b - 1];
+        bucket_start[0] = 0;
+
+        size_start = calloc(max_bucket_size + 2, sizeof(uint64_t));
+        placed = size_start != NULL ? 1 : LOESUNG_NO_MEMORY;
+    }
+
+    if (placed == 1) {
+        for (uint64_t b = 0; b < bucket_count; b++)
+            size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b]) + 1]++;
+        for (uint64_t size = 0; size <= max_bucket_size; size++)
+            size_start[size + 1] += size_start[size];
+        for (uint64_t b = 0; b < bucket_count; b++)
+            buckets[size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+    }
+
+    uint64_t next_free = 0;
+    for (uint64_t i = 0; i < bucket_count && placed == 1; i++) {
+        uint64_t b = buckets[i];
+        const uint64_t *words = bucket_entries + bucket_start[b];
+        uint64_t size = bucket_start[b + 1] - bucket_start[b];
+
+        pilots[b] = 0;
+        if (size == 0)
+            continue;
+
+        if (size == 1) {
+            while (taken[next_free])
+                next_free++;
+            taken[next_free] = 1;
+            slot_entries[next_free] = words[0];
+            pilots[b] = WBI_DIRECT | (uint32_t) next_free;
+            continue;
+        }
+
+        uint32_t pilot = 0;
+        for (; pilot < WBI_PILOT_LIMIT; pilot++) {
+            uint64_t pilot_hash = mix64(pilot);
+            uint64_t k = 0;
+
+            // Check the slots of all words against the table and each other.
+            for (; k < size; k++) {
+                uint64_t slot = WBI_SLOT(hashes[words[k]], pilot_hash, entry_count);
+                if (taken[slot])
+                    break;
+                taken[slot] = 1;
+            }
+
+            if (k == size)
+                break;
+            while (k-- > 0)
+                taken[WBI_SLOT(hashes[words[k]], pilot_hash, entry_count)] = 0;
+        }
+
+        if (pilot == WBI_PILOT_LIMIT)
+            placed = 0;
+        else {
+            pilots[b] = pilot;
+            for (uint64_t k = 0; k < size; k++)
+                slot_entries[WBI_SLOT(hashes[words[k]], mix64(pilot), entry_count)] = words[k];
+        }
+    }
+
+    free(size_start);
+    free(taken);
+    free(buckets);
+    free(bucket_entries);
+    free(bucket_start);
+    return placed;
+}
+
+/* Write an image to a temporary file first and rename it, so running processes never map a half written image. */
+int write_wbi_image(const unsigned char *image, size_t image_size, const char *image_path) {
+    size_t tmp_path_size = strlen(image_path) + 5;
+    char *tmp_path = malloc(tmp_path_size);
+    FILE *file_pointer = NULL;
+    bool written = tmp_path != NULL;
+
+    if (written) {
+        snprintf(tmp_path, tmp_path_size, "%s.tmp", image_path);
+        written = (file_pointer = fopen(tmp_path, "wb")) != NULL;
+    }
+    if (written) {
+        written = fwrite(image, 1, image_size, file_pointer) == image_size;
+        written = fclose(file_pointer) == 0 && written;
+        written = written && rename(tmp_path, image_path) == 0;
+        if (!written)
+            remove(tmp_path);
+    }
+
+    free(tmp_path);
+    return written ? LOESUNG_OK : LOESUNG_IO_ERROR;
+}
+
+/* Check if a file starts with the magic of a dictionary image. Only regular files can be mapped, so anything else is
+ * left untouched for the wb.file reader. */
+bool loesung_is_image(const char *path) {
+    unsigned char magic[8];
+    struct stat file_stat;
+    FILE *file_pointer;
+
+    if (stat(path, &file_stat) == -1 || !S_ISREG(file_stat.st_mode) || (file_pointer = fopen(path, "rb")) == NULL)
+        return false;
+
+    bool is_image = fread(magic, 1, sizeof(magic), file_pointer) == sizeof(magic) &&
+                    memcmp(magic, WBI_MAGIC, sizeof(magic)) == 0;
+    fclose(file_pointer);
+    return is_image;
+}
+
+/* Map a dictionary image read-only and check that all sections lie behind the header and within the file. The offsets
+ * come from the file, so they are checked by subtraction and a damaged image can't make them wrap around. The slots
+ * are checked against the blob when a lookup uses them and the checksum only by loesung_check_image(), which reads
+ * the whole image. Shared mappings of the same image are backed by the same page cache, so concurrent processes don't
+ * need any extra memory for the dictionary. */
+int map_wbi_image(struct Loesung_dictionary *dict, const char *path) {
+    struct stat file_stat;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) == -1 || fstat(fd, &file_stat) == -1) {
+        if (fd != -1)
+            close(fd);
+        return set_error(dict, LOESUNG_IO_ERROR, "Error opening file %s!", path);
+    }
+
+    size_t size = (size_t) file_stat.st_size;
+    const unsigned char *data = size < sizeof(struct WBI_header) ? MAP_FAILED :
+                                mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: wrong dictionary image format in %s!", path);
+
+    const struct WBI_header *header = (const struct WBI_header *) data;
+    bool valid = memcmp(header->magic, WBI_MAGIC, sizeof(header->magic)) == 0 && header->version == WBI_VERSION &&
+                 header->entry_count < WBI_DIRECT && header->bucket_count > 0 &&
+                 header->pilots_offset % 4 == 0 && header->pilots_offset >= sizeof(struct WBI_header) &&
+                 header->pilots_offset <= size &&
+                 header->bucket_count <= (size - header->pilots_offset) / sizeof(uint32_t) &&
+                 header->slots_offset % 8 == 0 && header->slots_offset >= sizeof(struct WBI_header) &&
+                 header->slots_offset <= size &&
+                 header->entry_count <= (size - header->slots_offset) / sizeof(struct WBI_slot) &&
+                 header->blob_offset >= sizeof(struct WBI_header) && header->blob_size <= size &&
+                 header->blob_offset <= size - header->blob_size &&
+                 (header->blob_size == 0 || data[header->blob_offset + header->blob_size - 1] == '\0');
+
+    if (!valid) {
+        munmap((void *) data, size);
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: wrong dictionary image format in %s!", path);
+    }
+
+    dict->image.header = header;
+    dict->image.pilots = (const uint32_t *) (data + header->pilots_offset);
+    dict->image.slots = (const struct WBI_slot *) (data + header->slots_offset);
+    dict->image.blob = data + header->blob_offset;
+    dict->image.map_size = size;
+    dict->entries = header->entry_count;
+    return LOESUNG_OK;
+}
+
+/* Unmap the dictionary image. */
+void unmap_wbi_image(struct WBI_image *image) {
+    munmap((void *) image->header, image->map_size);
+    image->header = NULL;
+    image->pilots = NULL;
+    image->slots = NULL;
+    image->blob = NULL;
+    image->map_size = 0;
+}
+
+/* Search for a word of len letters in any case in the dictionary image. The perfect hash only gives a slot, so the
+ * word has to be compared. Sets translation_len to the length of the translation from the slot. */
+const unsigned char *search_in_wbi_image(const struct WBI_image *image, const unsigned char *word, size_t len,
+                                         size_t *translation_len) {
+    const struct WBI_header *header = image->header;
+
+    if (header->entry_count == 0)
+        return NULL;
+
+    uint64_t hash = wbi_hash(word, len, header->seed);
+    uint32_t pilot = image->pilots[hash % header->bucket_count];
+    uint64_t index = (pilot & WBI_DIRECT) ? pilot & ~WBI_DIRECT : WBI_SLOT(hash, mix64(pilot), header->entry_count);
+
+    if (index >= header->entry_count)
+        return NULL;
+
+    const struct WBI_slot *slot = &image->slots[index];
+    if (slot->offset > header->blob_size ||
+        header->blob_size - slot->offset < (uint64_t) slot->word_length + slot->translation_length + 2)
+        return NULL;
+
+    const unsigned char *item_word = image->blob + slot->offset;
+    if (slot->word_length != len || !equals_folded(item_word, word, len))
+        return NULL;
+
+    *translation_len = slot->translation_length;
+    return item_word + slot->word_length + 1;
+}
@@ -1,590 +1,1271 @@
-#include <stdio.h>      // fprintf, fclose, fopen, getc
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      // fclose, fopen, fprintf, fwrite, getline, printf, rename, snprintf
 #include <stdbool.h>    // bool
-#include <stdint.h>     // uint64_t, uint8_t
-#include <stdlib.h>     // calloc, malloc, realloc, free
-#include <string.h>     // memcpy, strcmp, strlen
+#include <stdint.h>     // intptr_t, uint32_t, uint64_t
+#include <stdlib.h>     // bsearch, calloc, malloc, realloc, free, exit, qsort, strtol
+#include <string.h>     // memcpy, memset, strcmp, strcpy, strlen, strncmp, strrchr
+#include <dirent.h>     // closedir, opendir, readdir
+#include <errno.h>      // errno, EEXIST, EINTR, ECONNABORTED
+#include <fcntl.h>      // open
+#include <pthread.h>    // pthread_create, pthread_detach, pthread_join, pthread_mutex_lock, pthread_mutex_unlock
+#include <signal.h>     // pthread_sigmask, sigaddset, sigemptyset, signal, sigwait, SIGHUP, SIGPIPE
+#include <sys/socket.h> // accept, bind, connect, listen, shutdown, socket
+#include <sys/stat.h>   // mkdir, stat
+#include <sys/un.h>     // sockaddr_un
+#include <time.h>       // clock_gettime
+#include <unistd.h>     // close, read, sleep, sysconf, unlink
+
+#include "loesung.h"
 
 /**
- * Basic Idea:
- * 1. Read every word-translation-pair from a wb.file into a linked list.
- * 2. Traverse the linked list from head on and add every node to the hash table. While doing so, check for duplicates.
- * 3. The nodes now represent and item in the hashtable, so we don't have to "free" the linked list and allocate new
- * memory for the hash table. We simply use the nodes of the list for the hashtable.
- * 4. Read from stdin and check every word.
+ * Command line of loesung: translate stdin or a batch of documents with a dictionary, compile a dictionary to an image,
+ * or serve translations on a Unix domain socket and be the client of such a server. All the work is done by the
+ * library, this only deals with the options, the errors and the statistics.
  */
 
-/* Data structure for the linked list and the dictionary. The node contains strings and a pointer to the next node. */
-struct Node {
-    unsigned char *word;
-    unsigned char *translation;
-    struct Node *next_entry;
+/* Data structure for the options of the command line. threads is -1 until it is known if the server is started or
+ * documents are translated. The statistics go to stderr if there is no stats_path. */
+struct Options {
+    long threads;
+    uint64_t cache_size;
+    uint64_t batch_size;
+    bool print_cache_stats;
+    const char *serve_path;
+    bool print_stats;
+    const char *stats_path;
+    bool use_trie;
+    bool use_huge_pages;
+    const char *documents_path;
+    const char *output_path;
+    const char *profile_path;
+};
+
+/* Data structure for the reload of the dictionary from the same paths on SIGHUP, with the options it was loaded with.
+ * The mutex is held while a new dictionary is loaded. */
+struct Reloader {
+    struct Loesung_service *service;
+    char **paths;
+    int path_count;
+    struct Options options;
+    pthread_mutex_t mutex;
+};
+
+/* Data structure for the translation server. All workers accept clients on the same socket. */
+struct Server {
+    int fd;
+    struct Loesung_service *service;
+    uint64_t cache_size;
+    uint64_t batch_size;
+};
+
+// The server answers a client with frames of a type byte and the length of the payload as four bytes in big-endian
+// order. Data frames hold the translated text, the last frame holds the exit code and the error message, if any.
+#define FRAME_HEADER_SIZE 5u
+#define FRAME_DATA 'D'
+#define FRAME_STATUS 'S'
+#define FRAME_STATUS_SIZE 128u
+// Size of the blocks the client sends and of its buffer for the frames.
+#define CLIENT_BLOCK_SIZE (1u << 18u)
+
+/* Data structure for a document of the batch mode: the paths of the input and the translation, the size of the input
+ * and the result of its translation. */
+struct Document {
+    char *path;
+    char *output_path;
+    uint64_t size;
+    int ret;
 };
 
-/* Data structure for the hash table with the size and an array of pointers of type Node. */
-struct HT_dictionary {
-    uint64_t dict_size;
-    struct Node **dict_items;
+/* Data structure for the batch mode. The workers take the documents in order, that's the biggest first, next is the
+ * index of the next one in order. The counters of their translators are added to stats. */
+struct Batch {
+    struct Loesung_service *service;
+    const struct Options *options;
+    struct Document **order;
+    uint64_t count;
+    uint64_t next;
+    pthread_mutex_t mutex;
+    struct Loesung_stats stats;
 };
 
-/* The head of the linked list and the dictionary. */
-struct Node *first_entry = NULL;
-struct HT_dictionary *dictionary = NULL;
-
-/* Function prototypes for the linked list. */
-void delete_linked_list(void);
-void delete_node(void);
-bool prepend_to_linked_list(const unsigned char *, const unsigned char *);
-uint64_t read_wb_line(const unsigned char *);
-
-/* Function prototypes for the dictionary hash table. */
-struct HT_dictionary *create_new_ht_dictionary(uint64_t);
-void delete_ht_dictionary(void);
-void delete_ht_dictionary_item(struct Node *);
-uint64_t djb2_hash(const unsigned char *, uint64_t);
-uint64_t find_next_prime(uint64_t);
-bool is_prime(uint64_t);
-void insert_linked_list_node_to_ht_dictionary(void);
-void insert_to_ht_dictionary(struct Node *);
-unsigned char *search_in_ht_dictionary(const unsigned char *);
+// Name of the summary of the batch mode in the output directory.
+#define SUMMARY_NAME "summary.tsv"
+// Suffix of the temporary file a document is translated into before it is renamed to its output file.
+#define TMP_SUFFIX ".tmp"
+
+/* Function prototypes for the dictionary. */
+struct Loesung_service *load_dictionary(char *const *, int, const struct Options *, double *);
+struct Loesung_dictionary *read_layers(char *const *, int, const struct Options *, double *);
+int read_dictionary(struct Loesung_dictionary *, const char *, const struct Options *, double *);
+int compile_image(const char *, const char *);
+int check_image(const char *);
+int print_hash_stats(const char *);
+int print_profile(const char *, const char *, const char *);
+int report_error(struct Loesung_dictionary *, int);
+
+/* Function prototypes for the reload of the dictionary. */
+void block_reload_signal(void);
+void *reload_worker(void *);
 
 /* Function prototypes for read from stdin. */
-bool is_uppercase(int);
-bool is_letter(int);
-int read_from_stdin(void);
+int read_from_stdin(struct Loesung_service *, const struct Options *, struct Loesung_stats *);
+
+/* Function prototypes for the batch mode. */
+int translate_documents(struct Loesung_service *, const struct Options *, struct Loesung_stats *);
+struct Document *list_documents(const char *, const char *, uint64_t *);
+bool add_document(struct Document **, uint64_t *, uint64_t *, const char *, const char *);
+bool has_unique_names(const struct Document *, uint64_t);
+int compare_output_paths(const void *, const void *);
+bool is_apart_from_output(const struct Document *, uint64_t, const char *);
+int compare_documents(const void *, const void *);
+void *translate_document_worker(void *);
+int translate_document(struct Loesung_translator *, const struct Document *);
+void add_stats(struct Loesung_stats *, const struct Loesung_stats *);
+bool write_summary(const struct Document *, uint64_t, const char *);
+const char *document_status(int);
+int document_exit_code(int);
+
+/* Function prototypes for the statistics. */
+double wall_time(void);
+void print_word_cache_stats(const struct Loesung_stats *);
+void print_stats(FILE *, const double *, const struct Loesung_stats *, const struct Loesung_dictionary *);
+void print_dictionary_stats(FILE *, const struct Loesung_dictionary *, const char *);
+void print_probe_stats(FILE *, const struct Loesung_table_stats *, const char *);
+
+/* Function prototypes for the translation server and its client. */
+bool make_socket_address(struct sockaddr_un *, const char *);
+bool write_frame(int, unsigned char, const unsigned char *, size_t);
+bool write_data_frame(void *, const unsigned char *, size_t);
+void serve_client(int, struct Loesung_translator *);
+void *serve_worker(void *);
+int serve_translations(struct Loesung_service *, const struct Options *);
+ssize_t read_fully(int, unsigned char *, size_t);
+void *send_stdin(void *);
+int connect_translations(const char *);
+
+/* Function prototypes for the command line. */
+bool parse_count(const char *, long, long, long *);
 
 /* Program main entry point. */
 int main(int argc, char *argv[]) {
-    // Check program arguments.
-    if (argc != 2) {
-        fprintf(stderr, "Usage: cat stdin | %s filename\n", argv[0]);
+    // Compile a wb.file to a dictionary image or check an image.
+    if (argc == 4 && strcmp(argv[1], "--compile") == 0)
+        return compile_image(argv[2], argv[3]);
+    if (argc == 3 && strcmp(argv[1], "--check") == 0)
+        return check_image(argv[2]);
+
+    // Compare the hash functions on a wb.file.
+    if (argc == 3 && strcmp(argv[1], "--hash-stats") == 0)
+        return print_hash_stats(argv[2]);
+
+    // Count the words of a text into a profile and tell what it does to the lookups in a wb.file.
+    if (argc == 5 && strcmp(argv[1], "--profile") == 0)
+        return print_profile(argv[2], argv[3], argv[4]);
+
+    // Let a running server translate stdin.
+    if (argc == 3 && strcmp(argv[1], "--connect") == 0)
+        return connect_translations(argv[2]);
+
+    // Check program arguments. Options come in front of the filenames.
+    struct Options options = {-1, LOESUNG_DEFAULT_CACHE_SIZE, LOESUNG_DEFAULT_BATCH_SIZE, false, NULL, false, NULL,
+                              false, false, NULL, NULL, NULL};
+    long cache_size = 0;
+    long batch_size = 0;
+    int arg = 1;
+
+    while (arg < argc - 1) {
+        if (strcmp(argv[arg], "-j") == 0 && arg + 2 < argc &&
+            parse_count(argv[arg + 1], 0, LOESUNG_MAX_THREADS, &options.threads))
+            arg += 2;
+        else if (strcmp(argv[arg], "--cache") == 0 && arg + 2 < argc &&
+                 parse_count(argv[arg + 1], 0, LOESUNG_MAX_CACHE_SIZE, &cache_size)) {
+            options.cache_size = (uint64_t) cache_size;
+            arg += 2;
+        } else if (strcmp(argv[arg], "--batch") == 0 && arg + 2 < argc &&
+                   parse_count(argv[arg + 1], 1, LOESUNG_MAX_BATCH_SIZE, &batch_size)) {
+            options.batch_size = (uint64_t) batch_size;
+            arg += 2;
+        } else if (strcmp(argv[arg], "--cache-stats") == 0) {
+            options.print_cache_stats = true;
+            arg++;
+        } else if (strcmp(argv[arg], "--stats") == 0 || strncmp(argv[arg], "--stats=", 8) == 0) {
+            options.print_stats = true;
+            options.stats_path = argv[arg][7] == '=' ? argv[arg] + 8 : NULL;
+            arg++;
+        } else if (strcmp(argv[arg], "--trie") == 0) {
+            options.use_trie = true;
+            arg++;
+        } else if (strcmp(argv[arg], "--huge-pages") == 0) {
+            options.use_huge_pages = true;
+            arg++;
+        } else if (strcmp(argv[arg], "--use-profile") == 0 && arg + 2 < argc) {
+            options.profile_path = argv[arg + 1];
+            arg += 2;
+        } else if (strcmp(argv[arg], "--serve") == 0 && arg + 2 < argc) {
+            options.serve_path = argv[arg + 1];
+            arg += 2;
+        } else if (strcmp(argv[arg], "--documents") == 0 && arg + 3 < argc) {
+            options.documents_path = argv[arg + 1];
+            options.output_path = argv[arg + 2];
+            arg += 3;
+        } else
+            break;
+    }
+
+    // Every other argument is a dictionary, the first one on top. What looks like an option is a wrong one.
+    bool is_wrong_option = false;
+    for (int i = arg; i < argc; i++)
+        is_wrong_option = is_wrong_option || argv[i][0] == '-';
+
+    // The server runs until the process is stopped, it never gets to print statistics at the end.
+    bool is_wrong_mode = options.serve_path != NULL &&
+                         (options.documents_path != NULL || options.print_stats || options.print_cache_stats);
+
+    if (arg >= argc || is_wrong_option || is_wrong_mode) {
+        fprintf(stderr, "Usage: cat stdin | %s [-j threads] [--cache entries] [--batch words] [--cache-stats] "
+                        "[--stats[=file]] [--trie] [--huge-pages] [--use-profile profile] filename...\n", argv[0]);
+        fprintf(stderr, "       %s --documents list|directory output [-j threads] [--cache entries] [--batch words] "
+                        "[--cache-stats] [--stats[=file]] [--trie] [--huge-pages] [--use-profile profile] "
+                        "filename...\n", argv[0]);
+        fprintf(stderr, "       %s --serve socket [-j threads] [--cache entries] [--batch words] [--trie] "
+                        "[--huge-pages] [--use-profile profile] filename...\n", argv[0]);
+        fprintf(stderr, "       cat stdin | %s --connect socket\n", argv[0]);
+        fprintf(stderr, "       %s --compile filename image\n", argv[0]);
+        fprintf(stderr, "       %s --check image\n", argv[0]);
+        fprintf(stderr, "       %s --hash-stats filename\n", argv[0]);
+        fprintf(stderr, "       %s --profile text profile filename\n", argv[0]);
         return 2;
     }
     int ret = 0;
-    // Read wb.file to linked list.
-    uint64_t dict_size = read_wb_line((const unsigned char *) argv[1]);
 
-    // Create hashtable of desired size. The size is 1.5 times bigger up to the next prime.
-    // For example: if the file contains 1000 lines, then the size is find_next_prime(1000 + 500) = 1511.
-    dictionary = create_new_ht_dictionary(find_next_prime(dict_size + dict_size));
+    // -j 0 means a thread for every processor. That's also the default of the server and the batch mode, everything
+    // else runs on one thread by default.
+    if (options.threads == -1)
+        options.threads = options.serve_path != NULL || options.documents_path != NULL ? 0 : 1;
+    if (options.threads == 0)
+        options.threads = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? sysconf(_SC_NPROCESSORS_ONLN) : 1;
+
+    // SIGHUP reloads the dictionary. It is blocked before any thread is started, so only the reload thread takes it.
+    // Without the reload thread it stays blocked.
+    block_reload_signal();
+
+    // The start and end of the phases: reading the wb.file, building the hash table and translating.
+    // The reloader outlives main: a reload may still wait for the mutex while the process exits.
+    double times[4];
+    static struct Reloader reloader;
+    reloader.service = load_dictionary(argv + arg, argc - arg, &options, times);
+    reloader.paths = argv + arg;
+    reloader.path_count = argc - arg;
+    reloader.options = options;
+    pthread_mutex_init(&reloader.mutex, NULL);
+    pthread_t reload_thread;
+    if (pthread_create(&reload_thread, NULL, reload_worker, &reloader) == 0)
+        pthread_detach(reload_thread);
+
+    // Serve clients, translate the documents or read from standard input.
+    if (options.serve_path != NULL)
+        ret = serve_translations(reloader.service, &options);
+    else {
+        struct Loesung_stats stats = {0, 0, 0, 0, 0, 0, 0};
+        ret = options.documents_path != NULL ? translate_documents(reloader.service, &options, &stats)
+                                             : read_from_stdin(reloader.service, &options, &stats);
+        times[3] = wall_time();
+
+        if (options.print_cache_stats && options.cache_size > 0)
+            print_word_cache_stats(&stats);
+
+        if (options.print_stats) {
+            FILE *stats_file = options.stats_path != NULL ? fopen(options.stats_path, "w") : stderr;
+            if (stats_file == NULL)
+                fprintf(stderr, "Error: could not write statistics to %s!\n", options.stats_path);
+            else {
+                const struct Loesung_dictionary *dict = loesung_acquire_dictionary(reloader.service);
+                print_stats(stats_file, times, &stats, dict);
+                loesung_release_dictionary(reloader.service, dict);
+                if (stats_file != stderr)
+                    fclose(stats_file);
+            }
+        }
+
+        // The batch mode prints its errors itself and returns the exit code.
+        if (options.documents_path == NULL && loesung_translation_error(ret) != NULL) {
+            fprintf(stderr, "%s\n", loesung_translation_error(ret));
+            ret = 2;
+        }
+    }
+
+    // Wait for a reload which is under way, then delete the dictionary and free all allocated memory.
+    pthread_mutex_lock(&reloader.mutex);
+    loesung_delete_service(reloader.service);
+    return ret;
+}
+
+/* Functions for the dictionary. */
+/* Load the dictionaries of paths, take the times of the phases and put them in service. Exits on an error. */
+struct Loesung_service *load_dictionary(char *const *paths, int count, const struct Options *options, double *times) {
+    struct Loesung_dictionary *dict = read_layers(paths, count, options, times);
+    if (dict == NULL)
+        exit(2);
+
+    struct Loesung_service *service = loesung_create_service(dict);
+    if (service == NULL) {
+        fprintf(stderr, "Error: could not create dictionary - out of memory!\n");
+        loesung_delete_dictionary(dict);
+        exit(2);
+    }
+    return service;
+}
+
+/* Load the dictionaries of paths as layers, the first one on top, and take the times of the phases of all of them.
+ * Every layer is checked for duplicates on its own. Returns the top layer, or NULL after the error is printed. */
+struct Loesung_dictionary *read_layers(char *const *paths, int count, const struct Options *options, double *times) {
+    struct Loesung_dictionary *top = NULL;
+    double layer_times[3];
+    double read_time = 0;
+    times[0] = wall_time();
+
+    // Start with the base, every other layer lies on top of the one before.
+    for (int i = count - 1; i >= 0; i--) {
+        struct Loesung_dictionary *dict = loesung_create_dictionary();
+        int ret = dict != NULL ? read_dictionary(dict, paths[i], options, layer_times) : LOESUNG_NO_MEMORY;
+
+        if (ret != LOESUNG_OK) {
+            report_error(dict, ret);
+            if (count > 1)
+                fprintf(stderr, "Error: could not load dictionary %s!\n", paths[i]);
+            loesung_delete_dictionary(top);
+            return NULL;
+        }
+
+        loesung_set_base(dict, top);
+        top = dict;
+        read_time += layer_times[1] - layer_times[0];
+    }
 
-    // Write all entries of linked list to hashtable.
-    insert_linked_list_node_to_ht_dictionary();
+    times[1] = times[0] + read_time;
+    times[2] = wall_time();
+    return top;
+}
 
-    // Read from standard input.
-    ret = read_from_stdin();
+/* Load a dictionary and take the times of the phases. An image was already validated when it was compiled, so it
+ * only needs to be mapped. Otherwise read the wb.file and build the hash table, and the trie with --trie, in huge
+ * pages with --huge-pages. The hash table is laid out by the profile of --use-profile, the image and the trie don't
+ * take one. Returns the status, the message of an error is in the dictionary. */
+int read_dictionary(struct Loesung_dictionary *dict, const char *path, const struct Options *options, double *times) {
+    int ret;
+    times[0] = wall_time();
+    loesung_set_huge_pages(dict, options->use_huge_pages);
+
+    if (loesung_is_image(path)) {
+        ret = loesung_map_image(dict, path);
+        times[1] = wall_time();
+    } else {
+        ret = loesung_read_wb_file(dict, path);
+        times[1] = wall_time();
+        if (ret == LOESUNG_OK)
+            ret = loesung_build_table(dict, options->threads);
+        if (ret == LOESUNG_OK && options->profile_path != NULL && !options->use_trie)
+            ret = loesung_apply_profile(dict, options->profile_path, NULL);
+    }
+    if (ret == LOESUNG_OK && options->use_trie)
+        ret = loesung_build_trie(dict);
+    times[2] = wall_time();
 
-    // Delete the dictionary and free all allocated memory.
-    delete_ht_dictionary();
     return ret;
 }
 
-/* Functions for linked list. */
-/* Delete the entire linked list. This function is necessary to prevent memory leaks in case of failures. */
-void delete_linked_list(void) {
-    while (first_entry != NULL)
-        delete_node();
+/* Compile a wb.file to a dictionary image. The wb.file is read and checked for duplicates exactly like for a
+ * translation. */
+int compile_image(const char *wb_path, const char *image_path) {
+    struct Loesung_dictionary *dict = loesung_create_dictionary();
+    int ret = dict != NULL ? loesung_read_wb_file(dict, wb_path) : LOESUNG_NO_MEMORY;
+
+    if (ret == LOESUNG_OK)
+        ret = loesung_build_table(dict, 1);
+    if (ret == LOESUNG_OK)
+        ret = loesung_compile_image(dict, image_path);
+
+    return report_error(dict, ret);
 }
 
-/* Delete a single node from the head of the linked list. */
-void delete_node(void) {
-    // Create a temporary pointer of type Node which points at the head of the list.
-    struct Node *tmp = first_entry;
-    // The head become now the second item in the list.
-    first_entry = first_entry->next_entry;
+/* Check the checksum of a dictionary image. */
+int check_image(const char *path) {
+    struct Loesung_dictionary *dict = loesung_create_dictionary();
+    int ret = dict != NULL ? loesung_check_image(dict, path) : LOESUNG_NO_MEMORY;
 
-    // Set pointer for the next entry of the old head to NULL and free() everything.
-    tmp->next_entry = NULL;
+    return report_error(dict, ret);
+}
 
-    if (tmp == first_entry)
-        first_entry = NULL;
+/* Print the statistics of the hash table of a wb.file with every hash function as JSON to stdout, to pick the hash
+ * function for the dictionary. */
+int print_hash_stats(const char *wb_path) {
+    struct Loesung_dictionary *dict = loesung_create_dictionary();
+    int ret = dict != NULL ? loesung_read_wb_file(dict, wb_path) : LOESUNG_NO_MEMORY;
+    struct Loesung_table_stats table;
+
+    if (ret == LOESUNG_OK)
+        ret = loesung_build_table(dict, 1);
+    if (ret != LOESUNG_OK)
+        return report_error(dict, ret);
+
+    loesung_table_stats(dict, &table);
+    int hash_in_use = table.hash;
+    printf("{\n  \"entries\": %lu, \"slots\": %lu, \"load_factor\": %.4f,\n  \"hashes\": [\n", table.entries,
+           table.slots, table.slots > 0 ? (double) table.entries / (double) table.slots : 0.0);
+
+    for (int hash = 0; hash < LOESUNG_HASH_COUNT && ret == LOESUNG_OK; hash++) {
+        ret = loesung_hash_stats(dict, hash, &table);
+        if (ret == LOESUNG_OK) {
+            printf("    {\"hash\": \"%s\", \"in_use\": %s,\n", loesung_hash_name(hash),
+                   hash == hash_in_use ? "true" : "false");
+            print_probe_stats(stdout, &table, "      ");
+            printf("}%s\n", hash + 1 < LOESUNG_HASH_COUNT ? "," : "");
+        }
+    }
+    if (ret == LOESUNG_OK)
+        printf("  ]\n}\n");
 
-    free(tmp->translation);
-    free(tmp->word);
-    free(tmp);
+    return report_error(dict, ret);
 }
 
-/* Insert a new node to the linked list at the beginning of the list. */
-bool prepend_to_linked_list(const unsigned char *word, const unsigned char *translation) {
-    // Allocate memory for the node and the strings to insert the node to the linked list.
-    struct Node *new_node = malloc(sizeof(struct Node));
-    unsigned char *tmp_word = malloc(strlen((char *) word) + 1);
-    unsigned char *tmp_translation = malloc(strlen((char *) translation) + 1);
+/* Count the words of a text into a profile and print what the profile does to the hash table of a wb.file as JSON to
+ * stdout: the groups a token of the text probes on average without and with the profile, of all tokens and of the
+ * ones which are found, and the size of the strings of the profile at the front of the wb.file. */
+int print_profile(const char *text_path, const char *profile_path, const char *wb_path) {
+    struct Loesung_dictionary *dict = loesung_create_dictionary();
+    int ret = dict != NULL ? loesung_write_profile(dict, text_path, profile_path) : LOESUNG_NO_MEMORY;
+    struct Loesung_profile_stats profile;
+
+    if (ret == LOESUNG_OK)
+        ret = loesung_read_wb_file(dict, wb_path);
+    if (ret == LOESUNG_OK)
+        ret = loesung_build_table(dict, 1);
+    if (ret == LOESUNG_OK)
+        ret = loesung_apply_profile(dict, profile_path, &profile);
+    if (ret != LOESUNG_OK)
+        return report_error(dict, ret);
+
+    double tokens = profile.tokens > 0 ? (double) profile.tokens : 1.0;
+    double found_tokens = profile.found_tokens > 0 ? (double) profile.found_tokens : 1.0;
+    printf("{\n  \"words\": %lu, \"tokens\": %lu, \"found_tokens\": %lu, \"hit_ratio\": %.4f,\n", profile.words,
+           profile.tokens, profile.found_tokens, (double) profile.found_tokens / tokens);
+    printf("  \"profile_entries\": %lu, \"profile_bytes\": %lu,\n", profile.profile_entries, profile.profile_size);
+    printf("  \"probes_per_token\": {\"before\": %.4f, \"after\": %.4f},\n", (double) profile.probes_before / tokens,
+           (double) profile.probes_after / tokens);
+    printf("  \"probes_per_hit\": {\"before\": %.4f, \"after\": %.4f}\n}\n",
+           (double) profile.hit_probes_before / found_tokens, (double) profile.hit_probes_after / found_tokens);
+
+    return report_error(dict, ret);
+}
 
-    // If malloc() fucks up, return. We don't exit here, because we want to free() our allocated line and close() the
-    // open file pointer.
-    if (new_node == NULL || tmp_word == NULL || tmp_translation == NULL)
-        return false;
+/* Print the error of the dictionary, if any, and delete it. Returns the exit code. */
+int report_error(struct Loesung_dictionary *dict, int ret) {
+    if (dict == NULL)
+        fprintf(stderr, "Error: could not create dictionary - out of memory!\n");
+    else if (ret != LOESUNG_OK)
+        fprintf(stderr, "%s\n", loesung_error(dict));
 
-    // Add the data to the new node.
-    memcpy(tmp_word, word, strlen((char *) word) + 1);
-    memcpy(tmp_translation, translation, strlen((char *) translation) + 1);
-    new_node->word = tmp_word;
-    new_node->translation = tmp_translation;
-    new_node->next_entry = first_entry;
-    first_entry = new_node;
-    return true;
+    loesung_delete_dictionary(dict);
+    return ret != LOESUNG_OK ? 2 : 0;
 }
 
-/* Read the wb.file and insert its content to the linked list. */
-uint64_t read_wb_line(const unsigned char *argv) {
-    FILE *file_pointer;
+/* Functions for the reload of the dictionary. */
+/* Block SIGHUP in the calling thread, the threads it starts afterwards inherit it. */
+void block_reload_signal(void) {
+    sigset_t signals;
 
-    // Open file in read-only-mode.
-    if ((file_pointer = fopen((const char *) argv, "r")) == NULL) {
-        fprintf(stderr, "Error opening file %s!\n", argv);
-        exit(2);
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &signals, NULL);
+}
+
+/* Reload thread: wait for SIGHUP and load the dictionary anew from the same paths, while the old one goes on
+ * translating. The new dictionary is checked like the first one and only put in service if it is valid, otherwise the
+ * error is printed and the old one stays in use. The translators switch to the new one between two chunks. */
+void *reload_worker(void *arg) {
+    struct Reloader *reloader = arg;
+    sigset_t signals;
+    int signal_number;
+    double times[3];
+
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGHUP);
+
+    while (true) {
+        if (sigwait(&signals, &signal_number) != 0)
+            continue;
+
+        pthread_mutex_lock(&reloader->mutex);
+        struct Loesung_dictionary *dict = read_layers(reloader->paths, reloader->path_count, &reloader->options, times);
+
+        if (dict != NULL)
+            loesung_replace_dictionary(reloader->service, dict);
+        else
+            fprintf(stderr, "Error: could not reload the dictionary, the old one stays in use!\n");
+        pthread_mutex_unlock(&reloader->mutex);
     }
 
-    // Allocate some memory for an array to put the chars in.
-    size_t size_word = 1024;
-    size_t size_translation = 1024;
-    unsigned char *str_word = malloc(size_word);
-    unsigned char *str_translation = malloc(size_translation);
+    return NULL;
+}
+
+/* Functions for reading from standard input. */
+/* Translate stdin to stdout with the dictionary in service, with more than one thread the chunks are translated in
+ * parallel. The counters of the translation and the word cache are added to stats. Returns like
+ * loesung_translate_stream(). */
+int read_from_stdin(struct Loesung_service *service, const struct Options *options, struct Loesung_stats *stats) {
+    void *context = (void *) (intptr_t) STDOUT_FILENO;
 
     // Break if memory allocation fails.
-    if (str_word == NULL || str_translation == NULL) {
-        fprintf(stderr, "Error: could not start to read wb-file - out of memory!\n");
-        fclose(file_pointer);
+    struct Loesung_translator *translator = loesung_create_service_translator(service, options->cache_size);
+    if (translator == NULL) {
+        fprintf(stderr, "Error: could not start to read from stdin - out of memory!\n");
         exit(2);
     }
-    str_word[0] = '\0';
-    str_translation[0] = '\0';
-
-    int c = getc(file_pointer);     // Char to read.
-    uint64_t index_word = 0;        // Index for the word we read.
-    uint64_t index_translation = 0; // Index for the translation we read.
-    uint64_t wb_lines = 0;          // Count of lines we read -> how many entries will our dictionary have.
-    bool is_colon = false;          // To remember if there already was a colon in the line.
-
-    while (c != EOF) {
-        // Check for valid chars.
-        if ((c < 'a' || c > 'z') && c != ':' && c != '\n') {
-            fprintf(stderr, "Error: wrong dictionary format in line %lu!\n", wb_lines + 1);
-            free(str_translation);
-            free(str_word);
-            delete_linked_list();
-            fclose(file_pointer);
-            exit(2);
+    loesung_set_batch_size(translator, options->batch_size);
+
+    int ret = options->threads > 1 ? loesung_translate_parallel(translator, STDIN_FILENO, loesung_write_fd, context,
+                                                                options->threads)
+                                   : loesung_translate_stream(translator, STDIN_FILENO, loesung_write_fd, context);
+    loesung_translator_stats(translator, stats);
+
+    loesung_delete_translator(translator);
+    return ret;
+}
+
+/* Functions for the batch mode. */
+/* Translate every document of a list or a directory into a file of the same name in the output directory, which is
+ * created if it doesn't exist. The dictionary is loaded once and the documents are translated by a pool of threads,
+ * each of them alone. The biggest documents are handed out first, so a big one taken last doesn't keep a single thread
+ * busy while the others are done already. The result of every document goes to the summary in the output directory,
+ * in the order of the list. The counters of all translations are added to stats. Returns the exit code: 0 if all words
+ * of all documents were found, 1 if some were not and 2 if a document couldn't be translated. */
+int translate_documents(struct Loesung_service *service, const struct Options *options, struct Loesung_stats *stats) {
+    if (mkdir(options->output_path, 0777) != 0 && errno != EEXIST) {
+        fprintf(stderr, "Error: could not create the output directory %s!\n", options->output_path);
+        return 2;
+    }
+
+    uint64_t count = 0;
+    struct Document *documents = list_documents(options->documents_path, options->output_path, &count);
+    if (documents == NULL)
+        return 2;
+
+    struct Batch batch = {service, options, malloc((count > 0 ? count : 1) * sizeof(struct Document *)), count, 0,
+                          PTHREAD_MUTEX_INITIALIZER, {0, 0, 0, 0, 0, 0, 0}};
+    pthread_t *workers = malloc((size_t) options->threads * sizeof(pthread_t));
+    long started = 0;
+
+    for (uint64_t i = 0; batch.order != NULL && i < count; i++)
+        batch.order[i] = &documents[i];
+    if (batch.order != NULL)
+        qsort(batch.order, count, sizeof(struct Document *), compare_documents);
+
+    // Documents no worker got to stay out of memory.
+    while (batch.order != NULL && workers != NULL && started < options->threads &&
+           pthread_create(&workers[started], NULL, translate_document_worker, &batch) == 0)
+        started++;
+
+    for (long i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    int ret = 0;
+    for (uint64_t i = 0; i < count; i++)
+        ret = document_exit_code(documents[i].ret) > ret ? document_exit_code(documents[i].ret) : ret;
+
+    if (!write_summary(documents, count, options->output_path)) {
+        fprintf(stderr, "Error: could not write the summary to %s!\n", options->output_path);
+        ret = 2;
+    }
+    if (ret == 2)
+        fprintf(stderr, "Error: could not translate all documents, see %s/%s!\n", options->output_path,
+                SUMMARY_NAME);
+
+    *stats = batch.stats;
+    for (uint64_t i = 0; i < count; i++) {
+        free(documents[i].path);
+        free(documents[i].output_path);
+    }
+    free(documents);
+    free(batch.order);
+    free(workers);
+    pthread_mutex_destroy(&batch.mutex);
+    return ret;
+}
+
+/* Make the list of documents: every line of a list file is the path of a document, of a directory all regular files
+ * are. The translation of a document has its name in the output directory. Prints the error and returns NULL if the
+ * list can't be read, two documents have the same name, a document is in the output directory or has the name of the
+ * summary or there is not enough memory. */
+struct Document *list_documents(const char *path, const char *output_path, uint64_t *count) {
+    struct Document *documents = NULL;
+    uint64_t capacity = 0;
+    struct stat path_stat;
+    bool is_listed = stat(path, &path_stat) == 0;
+
+    *count = 0;
+    if (is_listed && S_ISDIR(path_stat.st_mode)) {
+        DIR *dir = opendir(path);
+        struct dirent *entry;
+        is_listed = dir != NULL;
+
+        while (is_listed && (entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+                continue;
+
+            size_t length = strlen(path) + strlen(entry->d_name) + 2;
+            char *document_path = malloc(length);
+            is_listed = document_path != NULL;
+            if (is_listed) {
+                snprintf(document_path, length, "%s/%s", path, entry->d_name);
+                struct stat document_stat;
+                if (stat(document_path, &document_stat) == 0 && S_ISREG(document_stat.st_mode))
+                    is_listed = add_document(&documents, count, &capacity, document_path, output_path);
+                free(document_path);
+            }
         }
 
-        // Reallocate if the char array for the word gets too big.
-        if (!is_colon && index_word + 1 == size_word) {
-            unsigned char *tmp = realloc(str_word, size_word *= 2);
-            if (!tmp) {
-                fprintf(stderr, "Error: could not read wb-file - out of memory!\n");
-                free(str_word);
-                free(str_translation);
-                delete_linked_list();
-                fclose(file_pointer);
-                exit(2);
-            } else
-                str_word = tmp;
+        if (dir != NULL)
+            closedir(dir);
+    } else if (is_listed) {
+        FILE *list = fopen(path, "r");
+        char *line = NULL;
+        size_t line_capacity = 0;
+        ssize_t length;
+        is_listed = list != NULL;
+
+        while (is_listed && (length = getline(&line, &line_capacity, list)) >= 0) {
+            while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r'))
+                line[--length] = '\0';
+            if (length > 0)
+                is_listed = add_document(&documents, count, &capacity, line, output_path);
         }
-        // Reallocate if the char array for the translation gets too big.
-        if (is_colon && index_translation + 1 == size_translation) {
-            unsigned char *tmp = realloc(str_translation, size_translation *= 2);
-            if (!tmp) {
-                fprintf(stderr, "Error: could not read wb-file - out of memory!\n");
-                free(str_word);
-                free(str_translation);
-                delete_linked_list();
-                fclose(file_pointer);
-                exit(2);
-            } else
-                str_translation = tmp;
+
+        free(line);
+        if (list != NULL)
+            fclose(list);
+    }
+
+    if (!is_listed)
+        fprintf(stderr, "Error: could not read the documents of %s!\n", path);
+    if (!is_listed || !has_unique_names(documents, *count) || !is_apart_from_output(documents, *count, output_path)) {
+        for (uint64_t i = 0; i < *count; i++) {
+            free(documents[i].path);
+            free(documents[i].output_path);
         }
+        free(documents);
+        return NULL;
+    }
 
-        // Check if the line index is at zero and if there is a colon.
-        if (str_word[0] == ':' || (c == ':' && is_colon == true)) {
-            fprintf(stderr, "Error: wrong dictionary format in line %lu!\n", wb_lines + 1);
-            free(str_word);
-            free(str_translation);
-            delete_linked_list();
-            fclose(file_pointer);
-            exit(2);
+    // An empty list still needs an array.
+    return documents != NULL ? documents : calloc(1, sizeof(struct Document));
+}
+
+/* Add a document to the list, which is resized by factor two if it is full. Its size is taken now, a document which
+ * can't be found gets size zero and fails when it is translated. Returns false if there is not enough memory. */
+bool add_document(struct Document **documents, uint64_t *count, uint64_t *capacity, const char *path,
+                  const char *output_path) {
+    if (*count == *capacity) {
+        uint64_t new_capacity = *capacity > 0 ? *capacity * 2 : 64;
+        struct Document *tmp = realloc(*documents, new_capacity * sizeof(struct Document));
+        if (!tmp)
+            return false;
+        *documents = tmp;
+        *capacity = new_capacity;
+    }
+
+    const char *name = strrchr(path, '/') != NULL ? strrchr(path, '/') + 1 : path;
+    size_t length = strlen(output_path) + strlen(name) + 2;
+    struct Document *document = &(*documents)[*count];
+    struct stat document_stat;
+
+    document->path = malloc(strlen(path) + 1);
+    document->output_path = malloc(length);
+    document->size = stat(path, &document_stat) == 0 ? (uint64_t) document_stat.st_size : 0;
+    // A document stays out of memory until a worker translates it.
+    document->ret = LOESUNG_NO_MEMORY;
+
+    if (document->path == NULL || document->output_path == NULL) {
+        free(document->path);
+        free(document->output_path);
+        return false;
+    }
+
+    strcpy(document->path, path);
+    snprintf(document->output_path, length, "%s/%s", output_path, name);
+    (*count)++;
+    return true;
+}
+
+/* Check that no two documents are translated to the same file, which happens if they have the same name in different
+ * directories. The workers would write it at the same time and one translation would be lost. The temporary file of a
+ * translation must not be the output of another document either. Prints the error and returns false if there are such
+ * documents or there is not enough memory. */
+bool has_unique_names(const struct Document *documents, uint64_t count) {
+    const struct Document **sorted = malloc((count > 0 ? count : 1) * sizeof(struct Document *));
+    bool is_unique = true;
+
+    if (sorted == NULL) {
+        fprintf(stderr, "Error: could not read the documents - out of memory!\n");
+        return false;
+    }
+
+    for (uint64_t i = 0; i < count; i++)
+        sorted[i] = &documents[i];
+    qsort(sorted, count, sizeof(struct Document *), compare_output_paths);
+
+    for (uint64_t i = 1; is_unique && i < count; i++) {
+        if (strcmp(sorted[i - 1]->output_path, sorted[i]->output_path) == 0) {
+            fprintf(stderr, "Error: the documents %s and %s have the same name!\n", sorted[i - 1]->path,
+                    sorted[i]->path);
+            is_unique = false;
         }
+    }
 
-        // If a newline appears and word-translation-pair was read, push it in the list.
-        if (c == '\n' && index_translation > 0) {
-            // Append terminating NULL-character.
-            str_word[index_word] = '\0';
-            str_translation[index_translation] = '\0';
-
-            if (!prepend_to_linked_list(str_word, str_translation)) {
-                fprintf(stderr, "Error: could not create dictionary - out of memory!\n");
-                free(str_word);
-                free(str_translation);
-                delete_linked_list();
-                fclose(file_pointer);
-                exit(2);
-            }
+    for (uint64_t i = 0; is_unique && i < count; i++) {
+        size_t length = strlen(sorted[i]->output_path) + sizeof(TMP_SUFFIX);
+        struct Document key = {NULL, malloc(length), 0, 0};
+        const struct Document *key_pointer = &key;
+        const struct Document **found = NULL;
 
-            // Set everything "back" to zero.
-            str_word[0] = '\0';
-            str_translation[0] = '\0';
-            is_colon = false;
-            index_word = index_translation = 0;
-            wb_lines++;
-        } else if (c == ':') {
-            // Notice first colon.
-            is_colon = true;
-        } else if (!is_colon)
-            // Write to word string or...
-            str_word[index_word++] = (char) c;
-        else
-            // ...to translation string.
-            str_translation[index_translation++] = (char) c;
-
-        c = getc(file_pointer);
-    }
-
-    // If the file has no line break at the end we have to check if we read a line.
-    if (index_translation > 0) {
-        str_word[index_word] = '\0';
-        str_translation[index_translation] = '\0';
-        if (!prepend_to_linked_list(str_word, str_translation)) {
-            fprintf(stderr, "Error: could not create dictionary - out of memory!\n");
-            free(str_word);
-            free(str_translation);
-            delete_linked_list();
-            fclose(file_pointer);
-            exit(2);
+        if (key.output_path != NULL) {
+            snprintf(key.output_path, length, "%s%s", sorted[i]->output_path, TMP_SUFFIX);
+            found = bsearch(&key_pointer, sorted, count, sizeof(struct Document *), compare_output_paths);
+        }
+        if (key.output_path == NULL || found != NULL) {
+            if (found != NULL)
+                fprintf(stderr, "Error: the document %s has the name of the temporary file of %s!\n", (*found)->path,
+                        sorted[i]->path);
+            else
+                fprintf(stderr, "Error: could not read the documents - out of memory!\n");
+            is_unique = false;
         }
-        wb_lines++;
+        free(key.output_path);
     }
 
-    // To read nothing is a valid input, but check first if it really was EOF.
-    if (feof(file_pointer) == 0) {
-        fprintf(stderr, "Error - could not create dictionary - wrong input!\n");
-        free(str_word);
-        free(str_translation);
-        delete_linked_list();
-        fclose(file_pointer);
-        exit(2);
+    free(sorted);
+    return is_unique;
+}
+
+/* Check that no document is in the output directory, where its translation would overwrite it, and that none is called
+ * like the summary, which would overwrite its translation. The directories are compared by device and inode, so other
+ * paths to the same directory are found as well. Prints the error and returns false if there is such a document. */
+bool is_apart_from_output(const struct Document *documents, uint64_t count, const char *output_path) {
+    struct stat output_stat;
+    // A missing output directory has no documents in it, the translations fail later.
+    bool has_output = stat(output_path, &output_stat) == 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        const char *name = strrchr(documents[i].path, '/');
+        struct stat directory_stat;
+        bool is_in_output = false;
+
+        if (has_output && name == NULL) {
+            is_in_output = stat(".", &directory_stat) == 0;
+        } else if (has_output) {
+            // The directory of the document is its path up to the last slash, or the root.
+            size_t length = name > documents[i].path ? (size_t) (name - documents[i].path) : 1;
+            char *directory = malloc(length + 1);
+            if (directory == NULL) {
+                fprintf(stderr, "Error: could not read the documents - out of memory!\n");
+                return false;
+            }
+            memcpy(directory, documents[i].path, length);
+            directory[length] = '\0';
+            is_in_output = stat(directory, &directory_stat) == 0;
+            free(directory);
+        }
+
+        is_in_output = is_in_output && directory_stat.st_dev == output_stat.st_dev &&
+                       directory_stat.st_ino == output_stat.st_ino;
+        if (is_in_output) {
+            fprintf(stderr, "Error: the document %s is in the output directory %s!\n", documents[i].path, output_path);
+            return false;
+        }
+        if (strcmp(name != NULL ? name + 1 : documents[i].path, SUMMARY_NAME) == 0) {
+            fprintf(stderr, "Error: the document %s has the name of the summary!\n", documents[i].path);
+            return false;
+        }
     }
 
-    free(str_word);
-    free(str_translation);
-    fclose(file_pointer);
-    return wb_lines;
+    return true;
 }
 
-/* Functions for dictionary hash table */
-/* Create new dictionary. */
-struct HT_dictionary *create_new_ht_dictionary(uint64_t size) {
-    // Allocate memory for the hash table.
-    struct HT_dictionary *ht = malloc(sizeof(*dictionary));
+/* Compare the output paths of two documents for qsort() and bsearch(). */
+int compare_output_paths(const void *a, const void *b) {
+    const struct Document *document_a = *(const struct Document *const *) a;
+    const struct Document *document_b = *(const struct Document *const *) b;
 
-    if (ht == NULL) {
-        fprintf(stderr, "Error: could not create dictionary - out of memory!\n");
-        delete_linked_list();
-        exit(2);
+    return strcmp(document_a->output_path, document_b->output_path);
+}
+
+/* Compare two documents for qsort(), the bigger one comes first. */
+int compare_documents(const void *a, const void *b) {
+    const struct Document *document_a = *(const struct Document *const *) a;
+    const struct Document *document_b = *(const struct Document *const *) b;
+
+    return (document_a->size < document_b->size) - (document_a->size > document_b->size);
+}
+
+/* Worker thread of the batch mode: take the next document in order and translate it, until there are none left. Every
+ * worker has its own translator, the dictionary is shared without locks and a reloaded one is taken up between two
+ * chunks. */
+void *translate_document_worker(void *arg) {
+    struct Batch *batch = arg;
+    struct Loesung_translator *translator = loesung_create_service_translator(batch->service,
+                                                                              batch->options->cache_size);
+
+    // Without memory for the cache the worker goes without.
+    if (translator == NULL)
+        translator = loesung_create_service_translator(batch->service, 0);
+    if (translator == NULL)
+        return NULL;
+    loesung_set_batch_size(translator, batch->options->batch_size);
+
+    while (true) {
+        pthread_mutex_lock(&batch->mutex);
+        struct Document *document = batch->next < batch->count ? batch->order[batch->next++] : NULL;
+        pthread_mutex_unlock(&batch->mutex);
+
+        if (document == NULL)
+            break;
+        document->ret = translate_document(translator, document);
     }
 
-    // Set the desired size...
-    ht->dict_size = size;
-    // ... and allocate an array of size elements for all the nodes we want to put in.
-    ht->dict_items = calloc(ht->dict_size, sizeof(struct Node *));
+    struct Loesung_stats stats;
+    loesung_translator_stats(translator, &stats);
+    pthread_mutex_lock(&batch->mutex);
+    add_stats(&batch->stats, &stats);
+    pthread_mutex_unlock(&batch->mutex);
 
-    if (ht->dict_items == NULL) {
-        fprintf(stderr, "Error: could not create dictionary - out of memory!\n");
-        delete_linked_list();
-        delete_ht_dictionary();
-        exit(2);
+    loesung_delete_translator(translator);
+    return NULL;
+}
+
+/* Translate a document into a temporary file and rename it to its output file, so an output file is either the old or
+ * the complete new translation and nothing is truncated before the input is read. Returns like
+ * loesung_translate_stream(), or LOESUNG_IO_ERROR if one of the files can't be opened or renamed. Like on the command
+ * line, failed writes don't change the result. */
+int translate_document(struct Loesung_translator *translator, const struct Document *document) {
+    size_t tmp_path_size = strlen(document->output_path) + sizeof(TMP_SUFFIX);
+    char *tmp_path = malloc(tmp_path_size);
+    if (tmp_path == NULL)
+        return LOESUNG_NO_MEMORY;
+    snprintf(tmp_path, tmp_path_size, "%s%s", document->output_path, TMP_SUFFIX);
+
+    int input = open(document->path, O_RDONLY);
+    int output = input >= 0 ? open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0666) : -1;
+    int ret = LOESUNG_IO_ERROR;
+
+    if (output >= 0) {
+        ret = loesung_translate_stream(translator, input, loesung_write_fd, (void *) (intptr_t) output);
+        close(output);
+        if (rename(tmp_path, document->output_path) != 0) {
+            unlink(tmp_path);
+            ret = LOESUNG_IO_ERROR;
+        }
     }
 
-    return ht;
+    if (input >= 0)
+        close(input);
+    free(tmp_path);
+    return ret;
 }
 
-/* Delete the entire hash table by running through it. */
-void delete_ht_dictionary(void) {
+/* Add the counters of a translator to the total. The word cache has the same size in all of them. */
+void add_stats(struct Loesung_stats *total, const struct Loesung_stats *stats) {
+    total->bytes += stats->bytes;
+    total->words += stats->words;
+    total->unknown += stats->unknown;
+    total->cache_entries = stats->cache_entries;
+    total->cache_hits += stats->cache_hits;
+    total->cache_misses += stats->cache_misses;
+    total->cache_uncached += stats->cache_uncached;
+}
 
-    for (uint64_t i = 0; i < dictionary->dict_size; i++) {
-        struct Node *item = dictionary->dict_items[i];
+/* Write the summary of the batch mode to the output directory: a line per document with the exit code the command
+ * line would have had, the status and the path, separated by tabs. Returns false on a write error. */
+bool write_summary(const struct Document *documents, uint64_t count, const char *output_path) {
+    size_t length = strlen(output_path) + sizeof(SUMMARY_NAME) + 1;
+    char *path = malloc(length);
+    if (path == NULL)
+        return false;
 
-        if (item != NULL)
-            delete_ht_dictionary_item(item);
-    }
+    snprintf(path, length, "%s/%s", output_path, SUMMARY_NAME);
+    FILE *summary = fopen(path, "w");
+    free(path);
+    if (summary == NULL)
+        return false;
 
-    free(dictionary->dict_items);
-    free(dictionary);
+    for (uint64_t i = 0; i < count; i++)
+        fprintf(summary, "%d\t%s\t%s\n", document_exit_code(documents[i].ret), document_status(documents[i].ret),
+                documents[i].path);
+
+    return fclose(summary) == 0;
 }
 
-/* Delete hash table item. */
-void delete_ht_dictionary_item(struct Node *item) {
-    free(item->word);
-    free(item->translation);
-    free(item);
+/* Return the status of a document in the summary for the result of its translation. */
+const char *document_status(int ret) {
+    if (ret == LOESUNG_OK)
+        return "found";
+    if (ret == LOESUNG_NOT_FOUND)
+        return "missing";
+    if (ret == LOESUNG_INVALID_INPUT)
+        return "invalid";
+    return ret == LOESUNG_NO_MEMORY ? "no-memory" : "io-error";
 }
 
-/* DJB2 hash function for strings. */
-uint64_t djb2_hash(const unsigned char *word, uint64_t collisions) {
-    uint64_t hash = 5381;
-    uint8_t c;
+/* Return the exit code of the command line for the result of a translation. */
+int document_exit_code(int ret) {
+    return ret == LOESUNG_OK || ret == LOESUNG_NOT_FOUND ? ret : 2;
+}
 
-    while ((c = *word++))
-        hash = ((hash << 5u) * hash) + c; // hash * 33 + c
+/* Functions for the statistics. */
+/* Return the time of a monotonic clock in seconds. */
+double wall_time(void) {
+    struct timespec time;
 
-    return (hash + collisions) % dictionary->dict_size;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double) time.tv_sec + (double) time.tv_nsec / 1e9;
 }
 
-/* Helpers to make the dictionary size prime. */
-uint64_t find_next_prime(uint64_t n) {
-    uint64_t next_prime = ++n;
+/* Print the counters of the word cache to stderr. */
+void print_word_cache_stats(const struct Loesung_stats *stats) {
+    uint64_t lookups = stats->cache_hits + stats->cache_misses + stats->cache_uncached;
 
-    // If the next number is even skip it so we will only check uneven numbers.
-    if (next_prime % 2 == 0)
-        next_prime++;
+    fprintf(stderr, "Word cache: %lu entries, %lu lookups, %lu hits, %lu misses, %lu uncached, hit rate %.2f%%\n",
+            stats->cache_entries, lookups, stats->cache_hits, stats->cache_misses, stats->cache_uncached,
+            lookups > 0 ? 100.0 * (double) stats->cache_hits / (double) lookups : 0.0);
+}
 
-    while (1) {
-        if (is_prime(next_prime))
-            return next_prime;
-        next_prime = next_prime + 2;
+/* Print the statistics of a run as JSON. times are the start and end of the phases. */
+void print_stats(FILE *file, const double *times, const struct Loesung_stats *stats,
+                 const struct Loesung_dictionary *dict) {
+    double translate_time = times[3] - times[2];
+    uint64_t found = stats->words - stats->unknown;
+
+    fprintf(file, "{\n  \"phases\": {\"read_wb_file_s\": %.6f, \"build_table_s\": %.6f, \"translate_s\": %.6f, "
+                  "\"total_s\": %.6f},\n", times[1] - times[0], times[2] - times[1], translate_time, times[3] - times[0]);
+    fprintf(file, "  \"input\": {\"bytes\": %lu, \"words\": %lu, \"found\": %lu, \"unknown\": %lu, "
+                  "\"hit_ratio\": %.4f},\n", stats->bytes, stats->words, found, stats->unknown,
+            stats->words > 0 ? (double) found / (double) stats->words : 0.0);
+    fprintf(file, "  \"lookups_per_s\": %.0f,\n  \"mb_per_s\": %.2f,\n",
+            translate_time > 0 ? (double) stats->words / translate_time : 0.0,
+            translate_time > 0 ? (double) stats->bytes / 1e6 / translate_time : 0.0);
+
+    fprintf(file, "  \"dictionary\": ");
+    print_dictionary_stats(file, dict, "    ");
+    fprintf(file, ",\n");
+
+    // The layers below the first dictionary, if any, from the top.
+    if (loesung_base(dict) != NULL) {
+        fprintf(file, "  \"bases\": [");
+        for (const struct Loesung_dictionary *base = loesung_base(dict); base != NULL; base = loesung_base(base)) {
+            print_dictionary_stats(file, base, "    ");
+            fprintf(file, "%s", loesung_base(base) != NULL ? ",\n    " : "],\n");
+        }
     }
+
+    fprintf(file, "  \"cache\": {\"entries\": %lu, \"hits\": %lu, \"misses\": %lu, \"uncached\": %lu}\n}\n",
+            stats->cache_entries, stats->cache_hits, stats->cache_misses, stats->cache_uncached);
+}
+
+/* Print the statistics of a single layer of a dictionary as a JSON object. The lines of the probes start with
+ * indent. The entries of a profile are only printed if there is one and the huge pages if they were asked for. */
+void print_dictionary_stats(FILE *file, const struct Loesung_dictionary *dict, const char *indent) {
+    struct Loesung_table_stats table;
+
+    loesung_table_stats(dict, &table);
+    fprintf(file, "{\"type\": \"%s\", \"hash\": \"%s\", \"entries\": %lu, \"slots\": %lu, \"load_factor\": %.4f, "
+                  "\"memory_bytes\": %lu,\n", table.is_image ? "image" : table.is_trie ? "trie" : "hash table",
+            table.is_image ? "perfect" : table.is_trie ? "none" : loesung_hash_name(table.hash), table.entries,
+            table.slots, table.slots > 0 ? (double) table.entries / (double) table.slots : 0.0, table.memory);
+    if (table.profile_entries > 0)
+        fprintf(file, "%s\"profile_entries\": %lu,\n", indent, table.profile_entries);
+    if (table.huge_memory > 0)
+        fprintf(file, "%s\"huge_pages\": {\"asked_bytes\": %lu, \"granted\": %lu, \"granted_ratio\": %.4f, "
+                      "\"pool\": %s},\n", indent, table.huge_memory, table.huge_pages,
+                (double) (table.huge_pages * LOESUNG_HUGE_PAGE_SIZE) / (double) table.huge_memory,
+                table.is_hugetlb ? "true" : "false");
+    print_probe_stats(file, &table, indent);
+    fprintf(file, "}");
 }
 
-bool is_prime(uint64_t n) {
-    uint64_t x = 2;
-    while (x <= n / 2) {
-        if (n % x == 0)
+/* Print the histograms, the mean probes and the longest probe sequence and cluster of a table as JSON members. Every
+ * line starts with indent. */
+void print_probe_stats(FILE *file, const struct Loesung_table_stats *table, const char *indent) {
+    fprintf(file, "%s\"probe_histogram\": [", indent);
+    for (uint64_t i = 0; i < LOESUNG_PROBE_BUCKETS; i++)
+        fprintf(file, "%lu%s", table->probe_histogram[i], i + 1 < LOESUNG_PROBE_BUCKETS ? ", " : "");
+    fprintf(file, "],\n%s\"group_histogram\": [", indent);
+    for (uint64_t i = 0; i < LOESUNG_GROUP_BUCKETS; i++)
+        fprintf(file, "%lu%s", table->group_histogram[i], i + 1 < LOESUNG_GROUP_BUCKETS ? ", " : "");
+    fprintf(file, "],\n%s\"mean_probes_hit\": %.3f, \"mean_probes_miss\": %.3f, \"longest_probe\": %lu, "
+                  "\"longest_cluster\": %lu", indent, table->mean_probes_hit, table->mean_probes_miss,
+            table->longest_probe, table->longest_cluster);
+}
+
+/* Functions for the translation server and its client. */
+/* Fill in the address of a Unix domain socket. Returns false if the path is too long. */
+bool make_socket_address(struct sockaddr_un *address, const char *path) {
+    memset(address, 0, sizeof(struct sockaddr_un));
+    address->sun_family = AF_UNIX;
+
+    if (strlen(path) >= sizeof(address->sun_path))
+        return false;
+
+    strcpy(address->sun_path, path);
+    return true;
+}
+
+/* Write the data as frames of the given type to fd, a frame holds less than 4 GiB. Returns false on a write error. */
+bool write_frame(int fd, unsigned char type, const unsigned char *data, size_t size) {
+    void *context = (void *) (intptr_t) fd;
+
+    do {
+        uint32_t length = size > UINT32_MAX ? UINT32_MAX : (uint32_t) size;
+        unsigned char header[FRAME_HEADER_SIZE] = {type, (unsigned char) (length >> 24u),
+                                                   (unsigned char) (length >> 16u), (unsigned char) (length >> 8u),
+                                                   (unsigned char) length};
+
+        if (!loesung_write_fd(context, header, FRAME_HEADER_SIZE) || !loesung_write_fd(context, data, length))
             return false;
-        x++;
-    }
+
+        data += length;
+        size -= length;
+    } while (size > 0);
+
     return true;
 }
 
-/* Insert node in the dictionary. After all word-translation-pairs are in the dictionary the linked list
- * is empty because all the nodes are now dictionary items and hence stored in the hash table.
- * Also perform a duplicate check for the dictionary. */
-void insert_linked_list_node_to_ht_dictionary(void) {
+/* Write function for the translation of a client, which goes out in data frames. The socket is passed as context. */
+bool write_data_frame(void *context, const unsigned char *data, size_t size) {
+    return write_frame((int) (intptr_t) context, FRAME_DATA, data, size);
+}
+
+/* Translate the text of a client like stdin and send it back in data frames, followed by a status frame with the exit
+ * code and the error message of the command line. An error only ends the translation of this client. */
+void serve_client(int fd, struct Loesung_translator *translator) {
+    int ret = loesung_translate_stream(translator, fd, write_data_frame, (void *) (intptr_t) fd);
+    const char *error = loesung_translation_error(ret);
+    unsigned char status[FRAME_STATUS_SIZE] = {error != NULL ? 2 : (unsigned char) ret};
+    size_t error_len = 0;
+
+    if (error != NULL)
+        error_len = (size_t) snprintf((char *) status + 1, FRAME_STATUS_SIZE - 1, "%s\n", error);
+
+    // If the client went away, this fails like the data frames did.
+    write_frame(fd, FRAME_STATUS, status, error_len + 1);
+}
+
+/* Worker thread of the server: accept a client, translate its text and go on with the next one. Every worker has its
+ * own translator, the dictionary is shared without locks and a reloaded one is taken up between two chunks. */
+void *serve_worker(void *arg) {
+    struct Server *server = arg;
+    struct Loesung_translator *translator = loesung_create_service_translator(server->service, server->cache_size);
+
+    // Without memory for the cache the worker goes without.
+    if (translator == NULL)
+        translator = loesung_create_service_translator(server->service, 0);
 
-    while (first_entry != NULL) {
-        // Temporary pointer to the head of the linked list.
-        struct Node *tmp = first_entry;
+    if (translator != NULL)
+        loesung_set_batch_size(translator, server->batch_size);
 
-        // Check for duplicates.
-        if (search_in_ht_dictionary(tmp->word) != NULL) {
-            fprintf(stderr, "Wrong dictionary format, found duplicate: <%s>!\n", tmp->word);
-            delete_linked_list();
-            delete_ht_dictionary();
-            exit(2);
+    while (translator != NULL) {
+        int client = accept(server->fd, NULL, NULL);
+
+        // Wait a moment if we are out of file descriptors or memory.
+        if (client < 0) {
+            if (errno != EINTR && errno != ECONNABORTED)
+                sleep(1);
+            continue;
         }
 
-        // The node next to the head becomes the new head...
-        first_entry = first_entry->next_entry;
-        tmp->next_entry = NULL;
-        // ...and the old head is inserted to the hash table.
-        insert_to_ht_dictionary(tmp);
+        serve_client(client, translator);
+        close(client);
     }
+
+    return NULL;
 }
 
-/* Insert a new word-translation-pair in the dictionary. */
-void insert_to_ht_dictionary(struct Node *item) {
-    // Calculate the hash a.k.a. where to store the node (the bucket).
-    uint64_t index = djb2_hash(item->word, 0);
-    // Set a pointer to that bucket.
-    struct Node *cur_item = dictionary->dict_items[index];
+/* Serve translations on a Unix domain socket with a pool of threads until the process is stopped. A socket left over
+ * from an earlier server is replaced. Only returns if no worker can run. */
+int serve_translations(struct Loesung_service *service, const struct Options *options) {
+    struct sockaddr_un address;
+    struct stat socket_stat;
+    struct Server server = {-1, service, options->cache_size, options->batch_size};
+
+    if (!make_socket_address(&address, options->serve_path)) {
+        fprintf(stderr, "Error: socket path %s is too long!\n", options->serve_path);
+        return 2;
+    }
+
+    if (stat(options->serve_path, &socket_stat) == 0 && S_ISSOCK(socket_stat.st_mode))
+        unlink(options->serve_path);
 
-    uint64_t collisions = 0;
-    // Try to put the item in. If some other item is already there, recalculate the hash to deal
-    // with the collision.
-    while (cur_item != NULL) {
-        index = djb2_hash(item->word, collisions);
-        cur_item = dictionary->dict_items[index];
-        collisions++;
+    server.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (server.fd < 0 || bind(server.fd, (const struct sockaddr *) &address, sizeof(address)) != 0 ||
+        listen(server.fd, SOMAXCONN) != 0) {
+        fprintf(stderr, "Error: could not listen on socket %s!\n", options->serve_path);
+        if (server.fd >= 0)
+            close(server.fd);
+        return 2;
     }
 
-    // Finally insert it at the empty index.
-    dictionary->dict_items[index] = item;
+    // A client which goes away must not stop the server.
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t *workers = malloc((size_t) options->threads * sizeof(pthread_t));
+    long started = 0;
+
+    while (workers != NULL && started < options->threads &&
+           pthread_create(&workers[started], NULL, serve_worker, &server) == 0)
+        started++;
+
+    for (long i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    fprintf(stderr, "Error: could not start the server - out of memory!\n");
+    free(workers);
+    close(server.fd);
+    unlink(options->serve_path);
+    return 2;
 }
 
-/* Search for a word in the dictionary. This is almost the same as inserting:
- * Calculate the hash and check if the word matches. If not, try again until a match or an emtpy bucket. */
-unsigned char *search_in_ht_dictionary(const unsigned char *word) {
-    uint64_t collisions = 1;
-    uint64_t index = djb2_hash(word, 0);
-    struct Node *item = dictionary->dict_items[index];
+/* Read size bytes from fd, less only at the end of the file. Returns the number of bytes read or -1 on a read error. */
+ssize_t read_fully(int fd, unsigned char *data, size_t size) {
+    size_t filled = 0;
+
+    while (filled < size) {
+        ssize_t bytes_read = read(fd, data + filled, size - filled);
 
-    while (item != NULL) {
-        if (strcmp((const char *) item->word, (const char *) word) == 0)
-            return item->translation;
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read < 0)
+            return -1;
+        if (bytes_read == 0)
+            break;
 
-        index = djb2_hash(word, collisions);
-        item = dictionary->dict_items[index];
-        collisions++;
+        filled += (size_t) bytes_read;
     }
 
-    return NULL;
+    return (ssize_t) filled;
 }
 
-/* Functions for reading from standard input. A lot of this comes from Benni. */
-int read_from_stdin(void) {
+/* Set by the sender of the client on a read error of stdin. It isn't part of the arguments of the thread, because the
+ * detached sender may still run after connect_translations returned. */
+bool is_stdin_read_error = false;
 
-    // Allocate some memory for two arrays to put the chars in. The second array is just a copy. We need this if we
-    // want to flip chars from upper to lowercase.
-    size_t size_search_pattern = 1024;
-    unsigned char *search_pattern = malloc(size_search_pattern);
-    unsigned char *search_pattern_cpy = malloc(size_search_pattern);
+/* Thread of the client which sends stdin to the server. The server is told about the end of the input by shutting
+ * down the writing side of the socket, also after a read error, which the client reports itself. */
+void *send_stdin(void *arg) {
+    int fd = (int) (intptr_t) arg;
+    unsigned char *block = malloc(CLIENT_BLOCK_SIZE);
 
-    // Break if memory allocation fails.
-    if (search_pattern == NULL || search_pattern_cpy == NULL) {
-        fprintf(stderr, "Error: could not start to read form stdin - out of memory!\n");
-        delete_ht_dictionary();
-        exit(2);
-    }
+    while (block != NULL) {
+        ssize_t bytes_read = read(STDIN_FILENO, block, CLIENT_BLOCK_SIZE);
 
-    int c;
-    int ret = 0;
-    size_t len = 0;
-    bool word_started = false;
-    bool last_word = false;
-    bool word_starts_uppercase = false;
-
-    // Read char by char until you get to the end of the file.
-    c = getc(stdin);
-
-    // To read nothing is a valid input, so we can exit here.
-    if (c == EOF) {
-        free(search_pattern);
-        free(search_pattern_cpy);
-
-        // But check if the file was really empty or was it some strange character?
-        if (feof(stdin) == 0) {
-            free(search_pattern);
-            free(search_pattern_cpy);
-            delete_ht_dictionary();
-            fprintf(stderr, "Error: wrong input format due to non valid character!\n");
-            exit(2);
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        // The server still translates what it got and sends its status, so the input ends here like at the end of file.
+        if (bytes_read < 0) {
+            __atomic_store_n(&is_stdin_read_error, true, __ATOMIC_RELEASE);
+            break;
         }
-        return ret;
+        if (bytes_read == 0 || !loesung_write_fd(arg, block, (size_t) bytes_read))
+            break;
     }
 
-    while (true) {
-        // Did we read a legal character? If not, we can break and check if feof() == 0.
-        if ((c != '\n') && ((c < ' ') || (c > '~'))) {
-            // But print the last word of the file first.
-            if (strlen((const char *) search_pattern) > 0)
-                last_word = true;
-            else
-                break;
-        }
+    shutdown(fd, SHUT_WR);
+    free(block);
+    return NULL;
+}
 
-        // Resize the arrays if the input becomes too big by factor two.
-        if (len == size_search_pattern) {
-            unsigned char *tmp = realloc(search_pattern, size_search_pattern *= 2);
-            // Break if reallocation fails.
-            if (!tmp) {
-                fprintf(stderr, "Error: could not read form stdin - out of memory!\n");
-                free(search_pattern);
-                free(search_pattern_cpy);
-                delete_ht_dictionary();
-                exit(2);
-            } else
-                search_pattern = tmp;
-
-            tmp = realloc(search_pattern_cpy, size_search_pattern);
-            if (!tmp) {
-                fprintf(stderr, "Error: could not read form stdin - out of memory!\n");
-                free(search_pattern);
-                free(search_pattern_cpy);
-                delete_ht_dictionary();
-                exit(2);
-            } else
-                search_pattern_cpy = tmp;
-        }
+/* Send stdin to a server and write the translation to stdout. Returns the exit code the server sent and prints its
+ * error message, so the client behaves like the command line with the dictionary of the server. */
+int connect_translations(const char *path) {
+    struct sockaddr_un address;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    if (fd < 0 || !make_socket_address(&address, path) ||
+        connect(fd, (const struct sockaddr *) &address, sizeof(address)) != 0) {
+        fprintf(stderr, "Error: could not connect to socket %s!\n", path);
+        if (fd >= 0)
+            close(fd);
+        return 2;
+    }
 
-        if (is_letter(c)) {
-            word_started = true;
-            // Add character to search pattern. c is in ASCII format, so casting is fine here.
-            search_pattern[len] = (char) c;
-            search_pattern_cpy[len++] = (char) c;
-        } else {
-            // Character is not a letter, hence the reading of the search pattern has finished or
-            // we read a valid char, but it is not a letter (delimiter).
-            if (word_started) {
-                // A word of only letters has been read.
-                // Make it a zero terminated string then.
-                search_pattern[len] = '\0';
-                search_pattern_cpy[len] = '\0';
-
-                // Check if first char is capitalized.
-                if (is_uppercase(search_pattern[0]))
-                    word_starts_uppercase = true;
-
-
-                // Make chars lowercase.
-                for (size_t i = 0; search_pattern_cpy[i] != '\0'; i++)
-                        search_pattern_cpy[i] = search_pattern_cpy[i] | 32u;
-
-                // Create a pointer to our translation.
-                unsigned char *translation = search_in_ht_dictionary(search_pattern_cpy);
-
-                // Print the original search pattern if it is not found in the dictionary and set
-                // the return value to 1.
-                if (translation == NULL) {
-                    fprintf(stdout, "<%s>", search_pattern);
-                    ret = 1;
-                } else {
-                    // If the search pattern is found and a translation returned we maybe need to
-                    // capitalize the first letter for output.
-                    if (word_starts_uppercase) {
-                        // Make the first letter uppercase.
-                        translation[0] = translation[0] & ~32u;
-
-                        // Print the capitalized translation....
-                        fprintf(stdout, "%s", translation);
-                        // ... and switch back to lowercase.
-                        translation[0] = translation[0] | 32u;
-                    } else
-                        // Print the lowercase translation.
-                        fprintf(stdout, "%s", translation);
-                }
-
-                // "Reset" the read-in array to zeros.
-                search_pattern[0] = '\0';
-                search_pattern_cpy[0] = '\0';
-
-                // Reset word variables.
-                len = 0;
-                word_started = false;
-                word_starts_uppercase = false;
-
-                // Print characters after current word without changing.
-                if (!last_word)
-                    fprintf(stdout, "%c", c);
-            } else {
-                if (c == EOF)
-                    break;
-                // Print characters between words without changing.
-                fprintf(stdout, "%c", c);
-            }
+    // The server closes the connection after an invalid character even if there is more input.
+    signal(SIGPIPE, SIG_IGN);
+
+    pthread_t sender;
+    size_t capacity = CLIENT_BLOCK_SIZE;
+    unsigned char *data = malloc(capacity);
+
+    if (data == NULL || pthread_create(&sender, NULL, send_stdin, (void *) (intptr_t) fd) != 0) {
+        fprintf(stderr, "Error: could not start to read from stdin - out of memory!\n");
+        free(data);
+        close(fd);
+        return 2;
+    }
+    pthread_detach(sender);
+
+    int ret = -1;
+
+    // Read frames until the status arrives. The sender may still be blocked reading stdin, it ends with the process.
+    while (ret == -1) {
+        unsigned char header[FRAME_HEADER_SIZE];
+        if (read_fully(fd, header, FRAME_HEADER_SIZE) != FRAME_HEADER_SIZE)
+            break;
+
+        size_t length = (size_t) header[1] << 24u | (size_t) header[2] << 16u | (size_t) header[3] << 8u | header[4];
+        if (length > capacity) {
+            unsigned char *tmp = realloc(data, length);
+            if (!tmp)
+                break;
+            data = tmp;
+            capacity = length;
         }
 
-        if (!last_word)
-            c = getc(stdin);
-        else
+        if (read_fully(fd, data, length) != (ssize_t) length)
+            break;
+
+        // Like on the command line, failed writes to stdout don't change the result.
+        if (header[0] == FRAME_DATA)
+            loesung_write_fd((void *) (intptr_t) STDOUT_FILENO, data, length);
+        else if (header[0] == FRAME_STATUS && length > 0) {
+            fwrite(data + 1, 1, length - 1, stderr);
+            ret = data[0];
+        } else
             break;
     }
 
-    // End of file or error?
-    if (feof(stdin) == 0) {
-        fprintf(stderr, "Error: wrong input format due to non valid character!\n");
-        free(search_pattern);
-        free(search_pattern_cpy);
-        delete_ht_dictionary();
-        exit(2);
+    free(data);
+
+    if (ret == -1) {
+        fprintf(stderr, "Error: lost the connection to the server!\n");
+        return 2;
+    }
+
+    // The command line stops at a read error like at an invalid character, unless the server already found one.
+    if (ret != 2 && __atomic_load_n(&is_stdin_read_error, __ATOMIC_ACQUIRE)) {
+        fprintf(stderr, "%s\n", loesung_translation_error(LOESUNG_INVALID_INPUT));
+        return 2;
     }
 
-    free(search_pattern);
-    free(search_pattern_cpy);
     return ret;
 }
 
-/* Helper functions to check if a character is capitalized or a letter. */
-bool is_uppercase(int input) {
-    return (((input >= 'A') && (input <= 'Z')));
-}
+/* Functions for the command line. */
+/* Parse a decimal number between min and max. */
+bool parse_count(const char *arg, long min, long max, long *count) {
+    char *end;
 
-bool is_letter(int input) {
-    return (((input >= 'A') && (input <= 'Z')) || ((input >= 'a' && input <= 'z')));
+    errno = 0;
+    long value = strtol(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || value < min || value > max)
+        return false;
+
+    *count = value;
+    return true;
 }
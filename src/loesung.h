@@ -0,0 +1,191 @@
+#ifndef LOESUNG_H
+#define LOESUNG_H
+
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint64_t
+
+/**
+ * Library of loesung, a translator which looks up every word of a text in a dictionary.
+ *
+ * Basic Idea:
+ * 1. Map the wb.file into memory and count its lines to create a hash table which is big enough for all entries.
+ * 2. Read every word-translation-pair and insert it right away to the hash table. While doing so, check for
+ * duplicates. The strings are not copied, the lines are split in place and the slots point into the mapped file.
+ * 3. The table is flat, its slots hold the offset of a word and the word packed into 64 bits, so the whole dictionary
+ * is freed with the table and the mapping.
+ * 4. Read the text and check every word.
+ *
+ * Alternatively the dictionary can be compiled once into an image which holds a minimal perfect hash index and all
+ * strings in one blob. Such an image is simply mapped read-only instead of steps 1.-3. Big dictionaries whose words
+ * have a lot in common can be turned into a trie after step 2., which stores every common beginning and every
+ * translation once. The hash table can be laid out by a profile of the words of a sample text: the most frequent words
+ * are inserted first and their strings are put next to each other at the front of the wb.file.
+ *
+ * A dictionary can lie on top of a base dictionary, which lies on top of another one and so on. Every layer is loaded
+ * and checked for duplicates on its own, a word is looked up layer by layer from the top and the first translation
+ * wins. So a small dictionary overrides a big one without rebuilding it.
+ *
+ * All state lives in a dictionary and its translators, so any number of dictionaries can be used in one process. A
+ * loaded dictionary is only read, any number of threads can translate with it at the same time, each with a translator
+ * of its own. No function prints anything or exits, they return a status instead and a dictionary keeps the message
+ * of its last error.
+ *
+ * A dictionary can be put in service to be replaced while it is used. Translators of a service take the dictionary
+ * in service anew for every chunk of their input, so they switch to a new one between two words, and the old one is
+ * deleted when the last of them is done with it.
+ */
+
+/* Results of the functions of the library. A translation returns LOESUNG_OK if all words were found and
+ * LOESUNG_NOT_FOUND if some were not. */
+enum Loesung_status {
+    LOESUNG_OK = 0,
+    LOESUNG_NOT_FOUND = 1,
+    LOESUNG_NO_MEMORY = -1,
+    LOESUNG_INVALID_INPUT = -2,
+    LOESUNG_IO_ERROR = -3,
+    LOESUNG_WRONG_FORMAT = -4
+};
+
+/* A dictionary, loaded from a wb.file or an image, and the layers below it. */
+struct Loesung_dictionary;
+
+/* A dictionary in service, which can be replaced by another one while translators use it. */
+struct Loesung_service;
+
+/* A translator holds what a thread needs to translate: the output buffer, the word cache and the counters. */
+struct Loesung_translator;
+
+/* A word for a batch lookup. The word has len letters in any case and doesn't need to be zero terminated. */
+struct Loesung_token {
+    const char *word;
+    size_t len;
+};
+
+/* Counters of the translations. Words which are too long for the word cache are not counted as misses, they are
+ * uncached. */
+struct Loesung_stats {
+    uint64_t bytes;
+    uint64_t words;
+    uint64_t unknown;
+    uint64_t cache_entries;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t cache_uncached;
+};
+
+// Buckets of the probe histogram of the table statistics, and of the group histogram: groups with 0 to 16 used slots.
+#define LOESUNG_PROBE_BUCKETS 16u
+#define LOESUNG_GROUP_BUCKETS 17u
+
+// Hash functions of the hash table. The library is built with one of them, LOESUNG_HASH selects it.
+#define LOESUNG_HASH_DJB2 0
+#define LOESUNG_HASH_FNV1A 1
+#define LOESUNG_HASH_WYHASH 2
+#define LOESUNG_HASH_COUNT 3
+
+/* Statistics of a dictionary. The probes of a word are the groups of slots a search for it looks at, the last bucket of
+ * the histogram counts all words with more probes. A cluster is a run of full groups. hash is the hash function of a
+ * hash table. A trie has a slot per node and the probes of a word are the nodes on the way to it, it has no clusters
+ * and a miss isn't counted. huge_memory is the memory which asked for huge pages, huge_pages the number of huge pages
+ * the system granted for it and is_hugetlb tells if they came from the huge page pool. profile_entries are the words
+ * a profile put at the front of the wb.file of a hash table. */
+struct Loesung_table_stats {
+    bool is_image;
+    bool is_trie;
+    int hash;
+    uint64_t entries;
+    uint64_t slots;
+    uint64_t memory;
+    uint64_t probe_histogram[LOESUNG_PROBE_BUCKETS];
+    uint64_t group_histogram[LOESUNG_GROUP_BUCKETS];
+    uint64_t longest_probe;
+    uint64_t longest_cluster;
+    double mean_probes_hit;
+    double mean_probes_miss;
+    uint64_t huge_memory;
+    uint64_t huge_pages;
+    bool is_hugetlb;
+    uint64_t profile_entries;
+};
+
+/* Statistics of a profile applied to a dictionary. words are the lines of the profile and tokens their counts added
+ * up, found_tokens are the ones the dictionary has. Their words, profile_entries of them, were moved to the front of
+ * the wb.file, where they take profile_size bytes. The probes are the groups all tokens probe together in the hash
+ * table before and after the profile was applied, the ones of the found tokens are hit_probes. */
+struct Loesung_profile_stats {
+    uint64_t words;
+    uint64_t tokens;
+    uint64_t found_tokens;
+    uint64_t profile_entries;
+    uint64_t profile_size;
+    uint64_t probes_before;
+    uint64_t probes_after;
+    uint64_t hit_probes_before;
+    uint64_t hit_probes_after;
+};
+
+/* Function which takes the output of a translation. Returns false on a write error, the rest of the output is dropped
+ * then, but the translation goes on. */
+typedef bool (*Loesung_write)(void *context, const unsigned char *data, size_t size);
+
+// The most threads a dictionary is read or a text is translated with.
+#define LOESUNG_MAX_THREADS 1024
+// Default and most entries of the word cache of a translator.
+#define LOESUNG_DEFAULT_CACHE_SIZE 4096u
+#define LOESUNG_MAX_CACHE_SIZE (1u << 24u)
+// Default and most words a translator looks up as a batch, whose lookups are prefetched before any of them is searched.
+// A batch of one word looks up every word on its own.
+#define LOESUNG_DEFAULT_BATCH_SIZE 16u
+#define LOESUNG_MAX_BATCH_SIZE 256u
+// Size of the huge pages a dictionary asks for, smaller parts of it don't ask for one.
+#define LOESUNG_HUGE_PAGE_SIZE (1u << 21u)
+
+/* Function prototypes for the dictionary. */
+struct Loesung_dictionary *loesung_create_dictionary(void);
+void loesung_delete_dictionary(struct Loesung_dictionary *);
+void loesung_set_base(struct Loesung_dictionary *, struct Loesung_dictionary *);
+const struct Loesung_dictionary *loesung_base(const struct Loesung_dictionary *);
+void loesung_set_huge_pages(struct Loesung_dictionary *, bool);
+const char *loesung_error(const struct Loesung_dictionary *);
+int loesung_load(struct Loesung_dictionary *, const char *, long);
+int loesung_read_wb_file(struct Loesung_dictionary *, const char *);
+int loesung_build_table(struct Loesung_dictionary *, long);
+int loesung_build_trie(struct Loesung_dictionary *);
+bool loesung_is_image(const char *);
+int loesung_map_image(struct Loesung_dictionary *, const char *);
+int loesung_compile_image(struct Loesung_dictionary *, const char *);
+int loesung_check_image(struct Loesung_dictionary *, const char *);
+uint64_t loesung_entries(const struct Loesung_dictionary *);
+void loesung_table_stats(const struct Loesung_dictionary *, struct Loesung_table_stats *);
+const char *loesung_hash_name(int);
+int loesung_hash_stats(struct Loesung_dictionary *, int, struct Loesung_table_stats *);
+
+/* Function prototypes for the profiles. */
+int loesung_write_profile(struct Loesung_dictionary *, const char *, const char *);
+int loesung_apply_profile(struct Loesung_dictionary *, const char *, struct Loesung_profile_stats *);
+
+/* Function prototypes for the dictionaries in service. */
+struct Loesung_service *loesung_create_service(struct Loesung_dictionary *);
+void loesung_delete_service(struct Loesung_service *);
+void loesung_replace_dictionary(struct Loesung_service *, struct Loesung_dictionary *);
+const struct Loesung_dictionary *loesung_acquire_dictionary(struct Loesung_service *);
+void loesung_release_dictionary(struct Loesung_service *, const struct Loesung_dictionary *);
+
+/* Function prototypes for the lookups. */
+const char *loesung_lookup(const struct Loesung_dictionary *, const char *, size_t);
+size_t loesung_lookup_batch(const struct Loesung_dictionary *, const struct Loesung_token *, size_t, const char **);
+
+/* Function prototypes for the translation. */
+struct Loesung_translator *loesung_create_translator(const struct Loesung_dictionary *, uint64_t);
+struct Loesung_translator *loesung_create_service_translator(struct Loesung_service *, uint64_t);
+void loesung_delete_translator(struct Loesung_translator *);
+void loesung_set_batch_size(struct Loesung_translator *, uint64_t);
+void loesung_translator_stats(const struct Loesung_translator *, struct Loesung_stats *);
+int loesung_translate_buffer(struct Loesung_translator *, const char *, size_t, char **, size_t *);
+int loesung_translate_stream(struct Loesung_translator *, int, Loesung_write, void *);
+int loesung_translate_parallel(struct Loesung_translator *, int, Loesung_write, void *, long);
+const char *loesung_translation_error(int);
+bool loesung_write_fd(void *, const unsigned char *, size_t);
+
+#endif
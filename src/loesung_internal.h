@@ -0,0 +1,277 @@
+#ifndef LOESUNG_INTERNAL_H
+#define LOESUNG_INTERNAL_H
+
+#include <pthread.h>    // pthread_mutex_t
+#include <stdbool.h>    // bool
+#include <stddef.h>     // size_t
+#include <stdint.h>     // uint8_t, uint32_t, uint64_t
+
+#include "loesung.h"
+
+/**
+ * Data structures of the dictionary and the functions the translation needs from it. Nothing in here is part of the
+ * interface of the library.
+ */
+
+/* Data structure for a region of memory which is meant to be backed by huge pages. It comes from the huge page pool
+ * if is_hugetlb is set. Otherwise it is aligned to a huge page and transparent huge pages are asked for, which the
+ * kernel may or may not grant. size is a multiple of LOESUNG_HUGE_PAGE_SIZE, data is NULL if no region is in
+ * use. */
+struct Huge_region {
+    unsigned char *data;
+    size_t size;
+    bool is_hugetlb;
+};
+
+/* Slot of the hash table. The word is stored as its offset into the wb.file, the translation follows it behind the
+ * terminating NULL-character. key is the word packed by pack_word(): a word of up to HT_KEY_LETTERS letters is
+ * compared by its key alone without touching the word, a longer one only compares the letters behind the key. */
+struct HT_slot {
+    uint64_t offset;
+    uint64_t key;
+};
+
+/* Data structure for the hash table. The slots come in groups which are probed at once: every slot has a control byte,
+ * which is HT_EMPTY, HT_BUSY while a thread fills the slot, or HT_FULL with the low seven bits of the hash. The
+ * control bytes of a group are compared to the hash of a word at once, so a probe rarely touches a slot and almost
+ * never a word which doesn't match. dict_size is a power of two and a multiple of the group size. All words and
+ * translations are in blob, that's the wb.file. The control bytes and the slots are in huge if it is in use. */
+struct HT_dictionary {
+    uint64_t dict_size;
+    uint8_t *ctrl;
+    struct HT_slot *slots;
+    const unsigned char *blob;
+    struct Huge_region huge;
+};
+
+/* Data structure for the mapped wb.file. map_size is zero if the file was read into a malloc()ed buffer or into huge,
+ * if it is in use. */
+struct WB_file {
+    unsigned char *data;
+    size_t size;
+    size_t map_size;
+    struct Huge_region huge;
+};
+
+/* Data structure for a part of the wb.file which is read by a thread of its own. max_lines is an upper bound for its
+ * entries. The first format error stops the shard, its line is the number of entries read before plus one. duplicate
+ * is the latest word the shard came across which is not the last one with its word. */
+struct WB_shard {
+    struct HT_dictionary *table;
+    unsigned char *begin;
+    unsigned char *end;
+    uint64_t max_lines;
+    uint64_t entries;
+    bool is_wrong_format;
+    const unsigned char *duplicate;
+};
+
+/* Header of a dictionary image. All sections are stored in native byte order behind the header:
+ * - a pilot per bucket of the minimal perfect hash (uint32_t), padded to eight bytes,
+ * - a slot per entry (struct WBI_slot), the index into this array is the perfect hash of the word,
+ * - the blob with all words and translations as NULL-terminated strings.
+ * The checksum covers everything behind the header. */
+struct WBI_header {
+    unsigned char magic[8];
+    uint32_t version;
+    uint32_t seed;
+    uint64_t entry_count;
+    uint64_t bucket_count;
+    uint64_t pilots_offset;
+    uint64_t slots_offset;
+    uint64_t blob_offset;
+    uint64_t blob_size;
+    uint64_t checksum;
+};
+
+/* Slot of a dictionary image. The translation follows the word in the blob. */
+struct WBI_slot {
+    uint64_t offset;
+    uint32_t word_length;
+    uint32_t translation_length;
+};
+
+/* Data structure for a mapped dictionary image. header is NULL if no image is in use. */
+struct WBI_image {
+    const struct WBI_header *header;
+    const uint32_t *pilots;
+    const struct WBI_slot *slots;
+    const unsigned char *blob;
+    size_t map_size;
+};
+
+/* Node of the trie. The label holds the letters of the edge from the parent, up to four of them are stored in label
+ * itself, longer labels in the string pool. first is the first letter, so the child for a letter is found without
+ * touching the labels. The children of a node are next to each other and ordered by
+ * first. translation is TRIE_NONE if no word ends at the node. */
+struct Trie_node {
+    uint32_t label;
+    uint32_t first_child;
+    uint32_t translation;
+    uint8_t label_length;
+    uint8_t child_count;
+    unsigned char first;
+};
+
+/* String pool of the trie, every string is stored once and zero terminated. index is an open addressing table of the
+ * offsets plus one to find the strings while the trie is built, it is dropped afterwards. */
+struct Trie_pool {
+    unsigned char *data;
+    uint64_t size;
+    uint64_t capacity;
+    uint32_t *index;
+    uint64_t index_size;
+    uint64_t count;
+};
+
+/* Data structure for a trie, the root is the first node. nodes is NULL if no trie is in use. Once the trie is built,
+ * the nodes and the strings of both pools are moved to huge if huge pages are asked for. */
+struct Trie {
+    struct Trie_node *nodes;
+    uint64_t node_count;
+    struct Trie_pool labels;
+    struct Trie_pool translations;
+    struct Huge_region huge;
+};
+
+/* Data structure for a dictionary: the hash table and the wb.file all the strings are in, a trie or a mapped image.
+ * table, trie.nodes and image.header are all NULL as long as nothing is loaded. A hash table laid out by a profile has
+ * the profile_entries words of the profile at the front of its wb.file. error is the message of the last error,
+ * if any. users counts who acquired the dictionary from a service, the mutex of the service guards it. base is the
+ * next layer, which is searched for the words this one doesn't have, or NULL. With use_huge_pages the wb.file, the
+ * hash table and the trie are loaded into huge pages. */
+struct Loesung_dictionary {
+    struct HT_dictionary *table;
+    struct WB_file wb_file;
+    struct Trie trie;
+    struct WBI_image image;
+    uint64_t entries;
+    uint64_t profile_entries;
+    char *error;
+    uint64_t users;
+    struct Loesung_dictionary *base;
+    bool use_huge_pages;
+};
+
+/* Data structure for a dictionary in service. generation counts the replacements, so a translator notices a new
+ * dictionary even if it got the address of the old one. */
+struct Loesung_service {
+    pthread_mutex_t mutex;
+    struct Loesung_dictionary *dict;
+    uint64_t generation;
+};
+
+#define WBI_MAGIC "LSGWBI\r\n"
+#define WBI_VERSION 2u
+/* Slot of a word in the perfect hash, pilot_hash is mix64() of the pilot of its bucket. The pilot is mixed into the
+ * hash before the final mix64(), so every bit of the slot depends on it. Only XOR-ing it onto the mixed hash isn't
+ * enough: with a power of two entry count the modulo keeps only the low bits, and words of a bucket which agree there
+ * collide for every pilot. */
+#define WBI_SLOT(hash, pilot_hash, entry_count) (mix64((hash) ^ (pilot_hash)) % (entry_count))
+// Average number of words per bucket of the perfect hash.
+#define WBI_BUCKET_LOAD 3u
+// A pilot with this bit set stores the slot of a bucket with a single word directly.
+#define WBI_DIRECT 0x80000000u
+#define WBI_PILOT_LIMIT (1u << 22u)
+#define WBI_SEED_LIMIT 16u
+
+// Slots of a group of the hash table and the control bytes. The table is filled up to seven eighths at most.
+#define HT_GROUP_SIZE 16u
+#define HT_EMPTY 0x00u
+#define HT_BUSY 0x01u
+#define HT_FULL 0x80u
+// Letters packed into the key of a slot, five bits each. A longer word keeps HT_KEY_LONG_LETTERS letters and its length
+// up to HT_KEY_LONG_LENGTH in the low eight bits, the top bit tells it apart.
+#define HT_KEY_LETTERS 12u
+#define HT_KEY_LONG_LETTERS 11u
+#define HT_KEY_LONG_LENGTH 255u
+#define HT_KEY_LONG 0x8000000000000000u
+// Offset of the trie which stands for none, the longest label of a node and the first size of a string pool.
+#define TRIE_NONE UINT32_MAX
+#define TRIE_LABEL_SIZE 255u
+#define TRIE_POOL_SIZE (1u << 12u)
+// First size of the index of the words of a text which are counted and of the blocks the text is read in. A word of a
+// profile which the dictionary doesn't have has no slot.
+#define PROFILE_INDEX_SIZE (1u << 12u)
+#define PROFILE_BLOCK_SIZE (1u << 16u)
+#define PROFILE_MISSING UINT64_MAX
+// Hash function of the hash table, one of LOESUNG_HASH_DJB2, LOESUNG_HASH_FNV1A and LOESUNG_HASH_WYHASH.
+#ifndef LOESUNG_HASH
+#define LOESUNG_HASH LOESUNG_HASH_WYHASH
+#endif
+// Start value and step of the DJB2 hash.
+#define DJB2_INIT 5381u
+#define DJB2_STEP(hash, c) ((((hash) << 5u) + (hash)) + (c)) // hash * 33 + c
+// Start value and prime of the FNV-1a hash.
+#define FNV1A_INIT 0xcbf29ce484222325u
+#define FNV1A_PRIME 0x100000001b3u
+// Secrets of the wyhash-like hash and the mask which folds eight letters to lowercase at once.
+#define WYHASH_SECRET_0 0xa0761d6478bd642fu
+#define WYHASH_SECRET_1 0xe7037ed1a0b428dbu
+#define WYHASH_SECRET_2 0x8ebc6af09c88c6e3u
+#define WYHASH_FOLD 0x2020202020202020u
+// Start value of the wyhash-like hash. It must not be WYHASH_SECRET_0, the first step would multiply by zero then.
+#define WYHASH_INIT WYHASH_SECRET_1
+// Product of two numbers to 128 bits with the halves folded by XOR, step for eight letters of the wyhash-like hash and
+// the length at the end.
+#define WYHASH_MUM(a, b) ((uint64_t) ((__uint128_t) (a) * (b)) ^ (uint64_t) (((__uint128_t) (a) * (b)) >> 64u))
+#define WYHASH_STEP(hash, chunk) WYHASH_MUM(((chunk) | WYHASH_FOLD) ^ WYHASH_SECRET_1, (hash) ^ WYHASH_SECRET_0)
+#define WYHASH_FINISH(hash, len) WYHASH_MUM((hash) ^ WYHASH_SECRET_2, (uint64_t) (len) ^ WYHASH_SECRET_1)
+// The hash function of the hash table eight letters at a time, so the translation hashes a word while it scans it:
+// HASH_START, HASH_CHUNK for every eight letters in chunk, the first one in the lowest byte and the last chunk of a
+// word padded with zeros, and HASH_FINISH with the length. This gives the same as hash_word().
+#if LOESUNG_HASH == LOESUNG_HASH_DJB2
+#define HASH_START DJB2_INIT
+#define HASH_CHUNK(hash, chunk, letters) \
+    for (unsigned hash_letter = 0; hash_letter < (letters); hash_letter++) \
+        (hash) = DJB2_STEP(hash, ((chunk) >> (8u * hash_letter) & 255u) | 32u)
+#define HASH_FINISH(hash, len) (hash)
+#elif LOESUNG_HASH == LOESUNG_HASH_FNV1A
+#define HASH_START FNV1A_INIT
+#define HASH_CHUNK(hash, chunk, letters) \
+    for (unsigned hash_letter = 0; hash_letter < (letters); hash_letter++) \
+        (hash) = ((hash) ^ (((chunk) >> (8u * hash_letter) & 255u) | 32u)) * FNV1A_PRIME
+#define HASH_FINISH(hash, len) (hash)
+#else
+#define HASH_START WYHASH_INIT
+#define HASH_CHUNK(hash, chunk, letters) (hash) = WYHASH_STEP(hash, chunk)
+#define HASH_FINISH(hash, len) WYHASH_FINISH(hash, len)
+#endif
+// Smallest part of the wb.file which is read by a thread of its own.
+#define MIN_SHARD_SIZE (1u << 20u)
+
+/* Function prototypes for the dictionary, which the translation uses. */
+const unsigned char *search_in_dictionary(const struct Loesung_dictionary *, const unsigned char *, size_t, uint64_t,
+                                          size_t *);
+void prefetch_in_dictionary(const struct Loesung_dictionary *, const uint64_t *, size_t);
+uint64_t hash_word(const unsigned char *, size_t);
+uint64_t pack_word(const unsigned char *, size_t);
+uint64_t mix64(uint64_t);
+const struct Loesung_dictionary *acquire_dictionary(struct Loesung_service *, uint64_t *);
+
+/* Function prototypes for the dictionary, which the trie uses. */
+uint64_t ht_slot_length(const struct HT_dictionary *, const struct HT_slot *);
+void free_ht_storage(struct HT_dictionary *);
+bool map_huge_region(struct Huge_region *, size_t);
+void unmap_huge_region(struct Huge_region *);
+uint64_t count_huge_pages(const struct Huge_region *);
+
+/* Function prototypes for the dictionary and the translation, which the profile uses. */
+int set_error(struct Loesung_dictionary *, int, const char *, ...) __attribute__((format(printf, 3, 4)));
+void clear_dictionary(struct Loesung_dictionary *);
+void unmap_wb_file(struct WB_file *);
+uint64_t ht_dictionary_size(uint64_t);
+struct HT_dictionary *create_new_ht_dictionary(uint64_t, const unsigned char *, bool);
+uint32_t match_ht_group(const uint8_t *, uint8_t);
+uint64_t probe_ht_groups(const struct HT_dictionary *, uint64_t, uint64_t);
+const unsigned char *insert_to_ht_dictionary(struct HT_dictionary *, const unsigned char *, size_t, uint64_t);
+bool equals_ht_key(const unsigned char *, uint64_t, const unsigned char *, size_t, uint64_t);
+bool is_letter(int);
+
+/* Function prototypes for the trie, which the dictionary uses. */
+int build_trie(struct Trie *, struct HT_dictionary *, uint64_t, bool);
+void delete_trie(struct Trie *);
+void trie_stats(const struct Trie *, struct Loesung_table_stats *);
+const unsigned char *search_in_trie(const struct Trie *, const unsigned char *, size_t, size_t *);
+
+#endif
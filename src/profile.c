@@ -0,0 +1,477 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>      // fclose, ferror, fopen, fprintf, fread, getline
+#include <stdbool.h>    // bool
+#include <stdint.h>     // uint8_t, uint32_t, uint64_t
+#include <stdlib.h>     // calloc, malloc, realloc, free, qsort, strtoull
+#include <string.h>     // memcmp, memcpy, memset, strlen
+
+#include "loesung_internal.h"
+
+/**
+ * Frequency profiles of the library. A profile counts the words of a sample of the texts to translate and lists them
+ * from the most frequent one on, a line per word with its count and the word in lowercase, separated by a tab. A hash
+ * table laid out by a profile is filled anew in that order, so the frequent words take the first free slot of their
+ * probe sequence and the rarer ones are pushed further. The strings move, too: the words of the profile and their
+ * translations are copied to the front of a new wb.file in the same order, all others behind them. So the strings the
+ * lookups need most often lie next to each other on a few pages and cache lines instead of all over the file.
+ */
+
+/* Data structure for a word while the text is counted. The word is in lowercase and zero terminated in the pool of the
+ * counter at offset. */
+struct Profile_word {
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t count;
+};
+
+/* Data structure for counting the words of a text. index is an open addressing table of the words plus one, zero is a
+ * free slot. index_size is a power of two, the index is kept at half load at most. */
+struct Profile_counter {
+    struct Profile_word *words;
+    uint64_t count;
+    uint64_t capacity;
+    uint64_t *index;
+    uint64_t index_size;
+    unsigned char *pool;
+    uint64_t pool_size;
+    uint64_t pool_capacity;
+};
+
+/* Data structure for a word of a profile while it is applied. slot is the slot of the word in the table the profile
+ * was read with and offset the word in its wb.file, both are PROFILE_MISSING if the dictionary doesn't have the word.
+ * The layout moves the word, offset follows it. */
+struct Profile_entry {
+    uint64_t count;
+    uint64_t hash;
+    uint64_t key;
+    uint64_t slot;
+    uint64_t offset;
+    uint64_t length;
+};
+
+/* Function prototypes for counting the words. */
+int count_profile_words(struct Profile_counter *, FILE *);
+bool add_profile_word(struct Profile_counter *, uint64_t);
+bool grow_profile_index(struct Profile_counter *);
+int compare_profile_words(const void *, const void *);
+bool write_profile_words(struct Profile_counter *, const char *);
+void free_profile_counter(struct Profile_counter *);
+
+/* Function prototypes for applying a profile. */
+int read_profile(const struct HT_dictionary *, FILE *, struct Profile_entry **, uint64_t *, uint64_t *);
+int layout_ht_dictionary(struct Loesung_dictionary *, struct Profile_entry *, uint64_t, uint64_t *);
+uint64_t move_ht_entry(struct HT_dictionary *, unsigned char *, uint64_t, const struct HT_dictionary *, uint64_t);
+uint64_t find_ht_slot(const struct HT_dictionary *, const unsigned char *, size_t, uint64_t, uint64_t);
+uint64_t count_miss_probes(const struct HT_dictionary *, uint64_t);
+void count_profile_probes(const struct HT_dictionary *, const struct Profile_entry *, uint64_t, uint64_t *,
+                          uint64_t *);
+
+/* Functions of the library interface. */
+/* Count the words of the text at text_path and write them as a profile to profile_path, the most frequent one first.
+ * Words are runs of letters, anything else only separates them, so any sample of text will do. The dictionary only
+ * keeps the message of an error. */
+int loesung_write_profile(struct Loesung_dictionary *dict, const char *text_path, const char *profile_path) {
+    FILE *text = fopen(text_path, "r");
+    if (text == NULL)
+        return set_error(dict, LOESUNG_IO_ERROR, "Error opening file %s!", text_path);
+
+    struct Profile_counter counter;
+    memset(&counter, 0, sizeof(struct Profile_counter));
+    int ret = count_profile_words(&counter, text);
+    fclose(text);
+
+    if (ret == LOESUNG_OK && !write_profile_words(&counter, profile_path))
+        ret = set_error(dict, LOESUNG_IO_ERROR, "Error: could not write profile %s!", profile_path);
+    else if (ret == LOESUNG_IO_ERROR)
+        set_error(dict, ret, "Error: could not read %s!", text_path);
+    else if (ret == LOESUNG_NO_MEMORY)
+        set_error(dict, ret, "Error: could not count the words of %s - out of memory!", text_path);
+
+    free_profile_counter(&counter);
+    return ret;
+}
+
+/* Lay out the hash table of the dictionary and its wb.file by the profile at profile_path. Both are built anew, so the
+ * old and the new ones take memory for a moment. stats, unless it is NULL, gets the probes of the words of the profile
+ * before and after. The dictionary must be loaded from a wb.file, on an error it is empty. */
+int loesung_apply_profile(struct Loesung_dictionary *dict, const char *profile_path,
+                          struct Loesung_profile_stats *stats) {
+    struct Loesung_profile_stats unused;
+    if (stats == NULL)
+        stats = &unused;
+    memset(stats, 0, sizeof(struct Loesung_profile_stats));
+
+    if (dict->table == NULL)
+        return set_error(dict, LOESUNG_WRONG_FORMAT, "Error: could not apply profile - no wb-file loaded!");
+
+    FILE *file = fopen(profile_path, "r");
+    if (file == NULL) {
+        clear_dictionary(dict);
+        return set_error(dict, LOESUNG_IO_ERROR, "Error opening file %s!", profile_path);
+    }
+
+    struct Profile_entry *entries = NULL;
+    uint64_t count = 0;
+    uint64_t line = 0;
+    int ret = read_profile(dict->table, file, &entries, &count, &line);
+    fclose(file);
+
+    if (ret == LOESUNG_OK) {
+        stats->words = count;
+        for (uint64_t i = 0; i < count; i++) {
+            stats->tokens += entries[i].count;
+            stats->found_tokens += entries[i].slot != PROFILE_MISSING ? entries[i].count : 0;
+        }
+        count_profile_probes(dict->table, entries, count, &stats->probes_before, &stats->hit_probes_before);
+        ret = layout_ht_dictionary(dict, entries, count, &stats->profile_size);
+    }
+
+    if (ret != LOESUNG_OK) {
+        free(entries);
+        clear_dictionary(dict);
+        if (ret == LOESUNG_WRONG_FORMAT)
+            return set_error(dict, ret, "Error: wrong profile format in line %lu!", line);
+        if (ret == LOESUNG_IO_ERROR)
+            return set_error(dict, ret, "Error: could not read profile %s!", profile_path);
+        return set_error(dict, ret, "Error: could not apply profile - out of memory!");
+    }
+
+    stats->profile_entries = dict->profile_entries;
+    count_profile_probes(dict->table, entries, count, &stats->probes_after, &stats->hit_probes_after);
+    free(entries);
+    return LOESUNG_OK;
+}
+
+/* Functions for counting the words. */
+/* Count the words of the text. The letters of a word are folded and put at the end of the pool right away, they only
+ * stay there if the word is new. */
+int count_profile_words(struct Profile_counter *counter, FILE *text) {
+    unsigned char block[PROFILE_BLOCK_SIZE];
+    uint64_t len = 0;
+    size_t size;
+
+    do {
+        size = fread(block, 1, PROFILE_BLOCK_SIZE, text);
+
+        for (size_t i = 0; i < size; i++) {
+            if (!is_letter(block[i])) {
+                if (len > 0 && !add_profile_word(counter, len))
+                    return LOESUNG_NO_MEMORY;
+                len = 0;
+                continue;
+            }
+
+            // Keep room for the terminating NULL-character.
+            if (counter->pool_size + len + 2 > counter->pool_capacity) {
+                uint64_t capacity = counter->pool_capacity > 0 ? counter->pool_capacity * 2 : PROFILE_BLOCK_SIZE;
+                unsigned char *pool = realloc(counter->pool, capacity);
+                if (pool == NULL)
+                    return LOESUNG_NO_MEMORY;
+                counter->pool = pool;
+                counter->pool_capacity = capacity;
+            }
+            counter->pool[counter->pool_size + len++] = block[i] | 32u;
+        }
+    } while (size == PROFILE_BLOCK_SIZE);
+
+    if (ferror(text))
+        return LOESUNG_IO_ERROR;
+    if (len > 0 && !add_profile_word(counter, len))
+        return LOESUNG_NO_MEMORY;
+    return LOESUNG_OK;
+}
+
+/* Count the word of len letters at the end of the pool. A new word is kept in the pool, otherwise it is dropped.
+ * Returns false if there is not enough memory. */
+bool add_profile_word(struct Profile_counter *counter, uint64_t len) {
+    if (counter->count * 2 >= counter->index_size && !grow_profile_index(counter))
+        return false;
+
+    const unsigned char *word = counter->pool + counter->pool_size;
+    uint64_t hash = hash_word(word, len);
+    uint64_t mask = counter->index_size - 1;
+    uint64_t index = hash & mask;
+
+    for (; counter->index[index] != 0; index = (index + 1) & mask) {
+        struct Profile_word *known = &counter->words[counter->index[index] - 1];
+        if (known->hash == hash && memcmp(counter->pool + known->offset, word, len) == 0 &&
+            counter->pool[known->offset + len] == '\0') {
+            known->count++;
+            return true;
+        }
+    }
+
+    if (counter->count == counter->capacity) {
+        uint64_t capacity = counter->capacity > 0 ? counter->capacity * 2 : PROFILE_INDEX_SIZE / 2;
+        struct Profile_word *words = realloc(counter->words, capacity * sizeof(struct Profile_word));
+        if (words == NULL)
+            return false;
+        counter->words = words;
+        counter->capacity = capacity;
+    }
+
+    counter->pool[counter->pool_size + len] = '\0';
+    counter->words[counter->count++] = (struct Profile_word) {hash, counter->pool_size, 1};
+    counter->index[index] = counter->count;
+    counter->pool_size += len + 1;
+    return true;
+}
+
+/* Double the index of the counter, or create it. Returns false if there is not enough memory. */
+bool grow_profile_index(struct Profile_counter *counter) {
+    uint64_t size = counter->index_size > 0 ? counter->index_size * 2 : PROFILE_INDEX_SIZE;
+    uint64_t *index = calloc(size, sizeof(uint64_t));
+
+    if (index == NULL)
+        return false;
+
+    for (uint64_t i = 0; i < counter->count; i++) {
+        uint64_t slot = counter->words[i].hash & (size - 1);
+        while (index[slot] != 0)
+            slot = (slot + 1) & (size - 1);
+        index[slot] = i + 1;
+    }
+
+    free(counter->index);
+    counter->index = index;
+    counter->index_size = size;
+    return true;
+}
+
+/* Order the words by their count, the most frequent one first. Words with the same count keep the order in which they
+ * first came up, so the profile of a text is always the same. */
+int compare_profile_words(const void *a, const void *b) {
+    const struct Profile_word *word_a = a;
+    const struct Profile_word *word_b = b;
+
+    if (word_a->count != word_b->count)
+        return word_a->count > word_b->count ? -1 : 1;
+    return word_a->offset < word_b->offset ? -1 : word_a->offset > word_b->offset;
+}
+
+/* Write the counted words as a profile, the most frequent one first. Returns false on a write error. */
+bool write_profile_words(struct Profile_counter *counter, const char *profile_path) {
+    FILE *profile = fopen(profile_path, "w");
+    if (profile == NULL)
+        return false;
+
+    if (counter->count > 0)
+        qsort(counter->words, counter->count, sizeof(struct Profile_word), compare_profile_words);
+
+    for (uint64_t i = 0; i < counter->count; i++)
+        fprintf(profile, "%lu\t%s\n", counter->words[i].count, counter->pool + counter->words[i].offset);
+
+    bool is_written = !ferror(profile);
+    return fclose(profile) == 0 && is_written;
+}
+
+/* Free the words, the index and the pool of the counter. */
+void free_profile_counter(struct Profile_counter *counter) {
+    free(counter->words);
+    free(counter->index);
+    free(counter->pool);
+    memset(counter, 0, sizeof(struct Profile_counter));
+}
+
+/* Functions for applying a profile. */
+/* Read the lines of a profile into entries and look up their words in the table. line is the number of the line read
+ * last, so it is the wrong one on a format error. */
+int read_profile(const struct HT_dictionary *table, FILE *file, struct Profile_entry **entries, uint64_t *count,
+                 uint64_t *line) {
+    char *text = NULL;
+    size_t text_size = 0;
+    uint64_t capacity = 0;
+    ssize_t len;
+    int ret = LOESUNG_OK;
+
+    while ((len = getline(&text, &text_size, file)) > 0) {
+        (*line)++;
+        if (text[len - 1] == '\n')
+            text[--len] = '\0';
+
+        // A line is the count, a tab and the word, nothing else.
+        char *end = text;
+        uint64_t word_count = text[0] >= '0' && text[0] <= '9' ? strtoull(text, &end, 10) : 0;
+        if (end == text || *end != '\t') {
+            ret = LOESUNG_WRONG_FORMAT;
+            break;
+        }
+
+        // The word starts behind the tab, for a line with only a count that would be behind its terminating NUL.
+        const unsigned char *word = (const unsigned char *) end + 1;
+        size_t length = 0;
+
+        while (word[length] != '\0' && is_letter(word[length]))
+            length++;
+        if (length == 0 || word[length] != '\0') {
+            ret = LOESUNG_WRONG_FORMAT;
+            break;
+        }
+
+        if (*count == capacity) {
+            capacity = capacity > 0 ? capacity * 2 : PROFILE_INDEX_SIZE;
+            struct Profile_entry *grown = realloc(*entries, capacity * sizeof(struct Profile_entry));
+            if (grown == NULL) {
+                ret = LOESUNG_NO_MEMORY;
+                break;
+            }
+            *entries = grown;
+        }
+
+        uint64_t hash = hash_word(word, length);
+        uint64_t key = pack_word(word, length);
+        uint64_t slot = find_ht_slot(table, word, length, hash, key);
+        if (slot == table->dict_size)
+            slot = PROFILE_MISSING;
+
+        (*entries)[(*count)++] = (struct Profile_entry) {
+                word_count, hash, key, slot, slot != PROFILE_MISSING ? table->slots[slot].offset : PROFILE_MISSING,
+                length};
+    }
+
+    if (ret == LOESUNG_OK && ferror(file))
+        ret = LOESUNG_IO_ERROR;
+    free(text);
+    return ret;
+}
+
+/* Build a new wb.file and hash table of the same size for the entries of the dictionary: the words of the profile in
+ * its order first, then all others. Their strings are copied to the new wb.file in the same order, the lines of the
+ * old one which were no entries are left out. profile_size is the size of the strings of the profile. The old table and
+ * wb.file are freed if there is enough memory for the new ones. */
+int layout_ht_dictionary(struct Loesung_dictionary *dict, struct Profile_entry *entries, uint64_t count,
+                         uint64_t *profile_size) {
+    const struct HT_dictionary *old = dict->table;
+    struct WB_file wb_file = {NULL, 0, 0, {NULL, 0, false}};
+
+    for (uint64_t i = 0; i < old->dict_size; i++) {
+        if (!(old->ctrl[i] & HT_FULL))
+            continue;
+
+        const unsigned char *word = old->blob + old->slots[i].offset;
+        uint64_t length = ht_slot_length(old, &old->slots[i]);
+        wb_file.size += length + 1 + strlen((const char *) word + length + 1) + 1;
+    }
+
+    if (dict->use_huge_pages && map_huge_region(&wb_file.huge, wb_file.size))
+        wb_file.data = wb_file.huge.data;
+    else
+        wb_file.data = malloc(wb_file.size > 0 ? wb_file.size : 1);
+
+    // A bit for every slot of the old table whose entry has moved already.
+    uint8_t *is_moved = calloc(old->dict_size / 8, 1);
+    struct HT_dictionary *table = wb_file.data != NULL && is_moved != NULL ?
+                                  create_new_ht_dictionary(old->dict_size, wb_file.data, dict->use_huge_pages) : NULL;
+
+    if (table == NULL) {
+        unmap_wb_file(&wb_file);
+        free(is_moved);
+        return LOESUNG_NO_MEMORY;
+    }
+
+    uint64_t filled = 0;
+    uint64_t profile_entries = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        uint64_t slot = entries[i].slot;
+        if (slot == PROFILE_MISSING)
+            continue;
+
+        // A word which is in the profile twice has moved with its first line.
+        if (is_moved[slot / 8] & (1u << (slot % 8))) {
+            entries[i].offset = table->slots[find_ht_slot(table, old->blob + entries[i].offset, entries[i].length,
+                                                          entries[i].hash, entries[i].key)].offset;
+            continue;
+        }
+
+        is_moved[slot / 8] |= (uint8_t) (1u << (slot % 8));
+        entries[i].offset = filled;
+        filled = move_ht_entry(table, wb_file.data, filled, old, slot);
+        profile_entries++;
+    }
+    *profile_size = filled;
+
+    for (uint64_t i = 0; i < old->dict_size; i++)
+        if ((old->ctrl[i] & HT_FULL) && !(is_moved[i / 8] & (1u << (i % 8))))
+            filled = move_ht_entry(table, wb_file.data, filled, old, i);
+
+    free(is_moved);
+    free_ht_storage(dict->table);
+    free(dict->table);
+    unmap_wb_file(&dict->wb_file);
+
+    dict->table = table;
+    dict->wb_file = wb_file;
+    dict->profile_entries = profile_entries;
+    return LOESUNG_OK;
+}
+
+/* Copy the word and the translation of a slot of the old table to the blob at offset and insert the word to the table.
+ * Returns the offset behind the translation. */
+uint64_t move_ht_entry(struct HT_dictionary *table, unsigned char *blob, uint64_t offset,
+                       const struct HT_dictionary *old, uint64_t slot) {
+    const unsigned char *word = old->blob + old->slots[slot].offset;
+    uint64_t length = ht_slot_length(old, &old->slots[slot]);
+    uint64_t size = length + 1 + strlen((const char *) word + length + 1) + 1;
+
+    memcpy(blob + offset, word, size);
+    insert_to_ht_dictionary(table, blob + offset, length, hash_word(word, length));
+    return offset + size;
+}
+
+/* Return the slot of a word in the table, or its size if the table doesn't have the word. This is the search of the
+ * dictionary, with the slot instead of the translation. */
+uint64_t find_ht_slot(const struct HT_dictionary *table, const unsigned char *word, size_t len, uint64_t hash,
+                      uint64_t key) {
+    uint64_t mask = table->dict_size / HT_GROUP_SIZE - 1;
+    uint64_t group = (hash >> 7u) & mask;
+    uint8_t tag = (uint8_t) (HT_FULL | (hash & 0x7fu));
+
+    for (uint64_t step = 1; true; step++) {
+        const uint8_t *ctrl = table->ctrl + group * HT_GROUP_SIZE;
+
+        for (uint32_t matches = match_ht_group(ctrl, tag); matches != 0; matches &= matches - 1) {
+            uint64_t index = group * HT_GROUP_SIZE + (uint64_t) __builtin_ctz(matches);
+            if (equals_ht_key(table->blob + table->slots[index].offset, table->slots[index].key, word, len, key))
+                return index;
+        }
+
+        if (match_ht_group(ctrl, HT_EMPTY) != 0)
+            return table->dict_size;
+        group = (group + step) & mask;
+    }
+}
+
+/* Count the groups a search for a word with the hash probes if the table doesn't have it: up to the first group with
+ * an empty slot. */
+uint64_t count_miss_probes(const struct HT_dictionary *table, uint64_t hash) {
+    uint64_t mask = table->dict_size / HT_GROUP_SIZE - 1;
+    uint64_t group = (hash >> 7u) & mask;
+    uint64_t probes = 1;
+
+    while (match_ht_group(table->ctrl + group * HT_GROUP_SIZE, HT_EMPTY) == 0)
+        group = (group + probes++) & mask;
+
+    return probes;
+}
+
+/* Add up the groups all tokens of the profile probe in the table, every word as often as it was counted, and the ones
+ * of the words the table has on their own. */
+void count_profile_probes(const struct HT_dictionary *table, const struct Profile_entry *entries, uint64_t count,
+                          uint64_t *probes, uint64_t *hit_probes) {
+    *probes = *hit_probes = 0;
+
+    for (uint64_t i = 0; i < count; i++) {
+        const struct Profile_entry *entry = &entries[i];
+
+        if (entry->offset == PROFILE_MISSING) {
+            *probes += entry->count * count_miss_probes(table, entry->hash);
+            continue;
+        }
+
+        uint64_t slot = find_ht_slot(table, table->blob + entry->offset, entry->length, entry->hash, entry->key);
+        uint64_t word_probes = entry->count * probe_ht_groups(table, entry->hash, slot / HT_GROUP_SIZE);
+        *probes += word_probes;
+        *hit_probes += word_probes;
+    }
+}
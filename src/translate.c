@@ -0,0 +1,1042 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>    // bool
+#include <stdint.h>     // intptr_t, uint8_t, uint64_t
+#include <stdlib.h>     // calloc, malloc, realloc, free
+#include <string.h>     // memcpy, memmove
+#include <errno.h>      // errno, EINTR
+#include <pthread.h>    // pthread_create, pthread_join, pthread_mutex_*, pthread_cond_*
+#include <sys/uio.h>    // struct iovec, writev
+#include <unistd.h>     // read, write
+
+#include "loesung_internal.h"
+
+// The reader scans the input with AVX2 or SSE2 if the compiler targets it, unless LOESUNG_SCALAR is defined.
+#if !defined(LOESUNG_SCALAR) && defined(__AVX2__)
+#include <immintrin.h>  // _mm256_*
+#define SCAN_WIDTH 32u
+#define SCAN_FULL_MASK 0xffffffffu
+#elif !defined(LOESUNG_SCALAR) && defined(__SSE2__)
+#include <emmintrin.h>  // _mm_*
+#define SCAN_WIDTH 16u
+#define SCAN_FULL_MASK 0xffffu
+#endif
+
+/**
+ * The translation of the library: the text is scanned for words, every word is looked up in the dictionary and its
+ * translation (or the word itself in angle brackets) goes to the output, everything between words is copied as is.
+ */
+
+/* Data structure for a buffer which collects the output. It is handed to write in one go when it is full. A buffer
+ * without a write function can't be flushed, it only grows. A vectored buffer writes to the file descriptor in context
+ * with writev(): iov points to long parts right where they are, in the input or the dictionary. Short parts like the
+ * capital first letters are copied to data as usual, the copies from pointed on get a part of their own in front of
+ * the next long part. */
+struct Output {
+    unsigned char *data;
+    size_t length;
+    size_t capacity;
+    Loesung_write write;
+    void *context;
+    bool failed;
+    bool is_vectored;
+    struct iovec *iov;
+    size_t iov_count;
+    size_t pointed;
+};
+
+// Longest word the word cache takes, so an entry fits in 32 bytes.
+#define WORD_CACHE_WORD_SIZE 15u
+
+/* Data structure for an entry of the word cache. The word is stored in lowercase, translation is NULL if the word is
+ * not in the dictionary and len is zero for an empty entry. Only the low half of the hash is kept to tell most other
+ * words apart before the word is compared, so the length of the translation fits in, too. */
+struct Word_cache_entry {
+    const unsigned char *translation;
+    uint32_t hash;
+    uint32_t translation_len;
+    uint8_t len;
+    unsigned char word[WORD_CACHE_WORD_SIZE];
+};
+
+/* Data structure for the counters of the word cache. Words which are too long for the cache are not counted as misses,
+ * they are uncached. */
+struct Word_cache_stats {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t uncached;
+};
+
+/* Data structure for the word cache, a small direct-mapped cache in front of the dictionary. Every thread has a cache of
+ * its own. size is a power of two. */
+struct Word_cache {
+    uint64_t size;
+    struct Word_cache_entry *entries;
+    struct Word_cache_stats stats;
+};
+
+/* Data structure for a translator. The word cache may be NULL. The counters of the cache are kept in the cache, stats
+ * only counts the bytes and the words. batch_size is the number of words which are looked up as a batch. A translator
+ * of a service only has a dictionary while it translates a chunk, generation is the one of the service it had then. */
+struct Loesung_translator {
+    const struct Loesung_dictionary *dict;
+    struct Loesung_service *service;
+    uint64_t generation;
+    struct Word_cache *cache;
+    uint64_t batch_size;
+    struct Output out;
+    struct Loesung_stats stats;
+};
+
+/* Data structure for a word of a batch: the word of len letters, its translation of translation_len characters once it
+ * is looked up and the end of the characters behind it up to the next word. Only the first word of a chunk may be
+ * empty. The hashes of a batch are kept apart, they are prefetched together. */
+struct Batch_word {
+    const unsigned char *word;
+    size_t len;
+    const unsigned char *translation;
+    size_t translation_len;
+    const unsigned char *gap_end;
+};
+
+/* Data structure for a chunk of the input which is translated by a worker thread. Only the first length bytes are
+ * translated, the rest up to filled is the beginning of a word which is carried over to the next chunk. */
+struct Chunk {
+    unsigned char *data;
+    size_t capacity;
+    size_t length;
+    size_t filled;
+    struct Output out;
+    int ret;
+    bool is_valid;
+    bool is_done;
+};
+
+/* Data structure for the ring of chunks the main thread shares with the workers. submitted and taken count the chunks
+ * handed over and picked up so far, the chunk of a number is chunks[number % chunk_count]. The workers translate like
+ * translator and add their counters to it. */
+struct Chunk_queue {
+    pthread_mutex_t mutex;
+    pthread_cond_t work;
+    pthread_cond_t done;
+    struct Chunk *chunks;
+    uint64_t chunk_count;
+    uint64_t submitted;
+    uint64_t taken;
+    bool is_finished;
+    struct Loesung_translator *translator;
+};
+
+// Size of the blocks read from the input and of the output buffer.
+#define INPUT_BLOCK_SIZE (1u << 18u)
+#define OUTPUT_BUFFER_SIZE (1u << 18u)
+// Size of the chunks for the worker threads.
+#define PARALLEL_CHUNK_SIZE (1u << 20u)
+// Most parts of a vectored output which are written at once, that's IOV_MAX on Linux. Shorter parts than
+// OUTPUT_REFERENCE_SIZE are copied, the kernel takes longer for a part of its own than memcpy() for a few bytes.
+#define OUTPUT_IOV_COUNT 1024u
+#define OUTPUT_REFERENCE_SIZE 256u
+
+/* Function prototypes for the output buffer. */
+void output_flush(struct Output *);
+void output_flush_vectored(struct Output *);
+bool output_write(struct Output *, const void *, size_t);
+bool output_reference(struct Output *, const void *, size_t);
+void output_point(struct Output *, const void *, size_t);
+bool start_vectored_output(struct Output *);
+
+/* Function prototypes for the translation. */
+bool is_uppercase(int);
+bool is_valid_character(int);
+const unsigned char *scan_letters(const unsigned char *, const unsigned char *, uint64_t *);
+const unsigned char *scan_delimiters(const unsigned char *, const unsigned char *);
+#ifdef SCAN_WIDTH
+unsigned scan_letter_mask(const unsigned char *);
+unsigned scan_stop_mask(const unsigned char *);
+#endif
+const unsigned char *search_word(struct Loesung_translator *, const unsigned char *, size_t, uint64_t, size_t *);
+int write_word(struct Output *, const unsigned char *, size_t, const unsigned char *, size_t);
+int translate_chunk(struct Loesung_translator *, struct Output *, const unsigned char *, size_t, bool *);
+int translate_batches(struct Loesung_translator *, struct Output *, const unsigned char *, size_t, bool *);
+size_t chunk_length(const unsigned char *, size_t, bool);
+ssize_t read_chunk(int, unsigned char *, size_t, size_t, bool, bool *);
+
+/* Function prototypes for the word cache. */
+uint64_t word_cache_entries(uint64_t);
+struct Word_cache *create_word_cache(uint64_t);
+void delete_word_cache(struct Word_cache *);
+void clear_word_cache(struct Word_cache *);
+const unsigned char *search_in_word_cache(const struct Loesung_dictionary *, struct Word_cache *,
+                                          const unsigned char *, size_t, uint64_t, size_t *);
+
+/* Function prototypes for the parallel translation. */
+void *translate_chunk_worker(void *);
+void add_translator_stats(struct Loesung_translator *, const struct Loesung_translator *);
+bool fill_chunk(int, struct Chunk *, const struct Chunk *, bool *);
+
+/* Functions of the library interface. */
+/* Create a translator for a dictionary with a word cache of at least cache_size entries, 0 turns the cache off.
+ * Returns NULL if there is not enough memory. */
+struct Loesung_translator *loesung_create_translator(const struct Loesung_dictionary *dict, uint64_t cache_size) {
+    struct Loesung_translator *translator = calloc(1, sizeof(struct Loesung_translator));
+    if (translator == NULL)
+        return NULL;
+
+    if (cache_size > LOESUNG_MAX_CACHE_SIZE)
+        cache_size = LOESUNG_MAX_CACHE_SIZE;
+
+    translator->dict = dict;
+    translator->cache = cache_size > 0 ? create_word_cache(cache_size) : NULL;
+    translator->batch_size = LOESUNG_DEFAULT_BATCH_SIZE;
+    translator->out = (struct Output) {malloc(OUTPUT_BUFFER_SIZE), 0, OUTPUT_BUFFER_SIZE, NULL, NULL, false, false,
+                                      NULL, 0, 0};
+
+    if (translator->out.data == NULL || (cache_size > 0 && translator->cache == NULL)) {
+        loesung_delete_translator(translator);
+        return NULL;
+    }
+    return translator;
+}
+
+/* Create a translator for the dictionary in service, with a word cache like loesung_create_translator(). It takes the
+ * dictionary anew for every chunk of its input, so it switches to a replaced dictionary between two chunks. Returns
+ * NULL if there is not enough memory. */
+struct Loesung_translator *loesung_create_service_translator(struct Loesung_service *service, uint64_t cache_size) {
+    struct Loesung_translator *translator = loesung_create_translator(NULL, cache_size);
+    if (translator != NULL)
+        translator->service = service;
+    return translator;
+}
+
+/* Delete a translator. */
+void loesung_delete_translator(struct Loesung_translator *translator) {
+    if (translator == NULL)
+        return;
+
+    free(translator->out.data);
+    free(translator->out.iov);
+    delete_word_cache(translator->cache);
+    free(translator);
+}
+
+/* Set the number of words the translator looks up as a batch, from 1 to LOESUNG_MAX_BATCH_SIZE. */
+void loesung_set_batch_size(struct Loesung_translator *translator, uint64_t batch_size) {
+    if (batch_size < 1)
+        batch_size = 1;
+    if (batch_size > LOESUNG_MAX_BATCH_SIZE)
+        batch_size = LOESUNG_MAX_BATCH_SIZE;
+
+    translator->batch_size = batch_size;
+}
+
+/* Get the counters of all translations of a translator so far. */
+void loesung_translator_stats(const struct Loesung_translator *translator, struct Loesung_stats *stats) {
+    *stats = translator->stats;
+
+    if (translator->cache != NULL) {
+        stats->cache_entries = translator->cache->size;
+        stats->cache_hits = translator->cache->stats.hits;
+        stats->cache_misses = translator->cache->stats.misses;
+        stats->cache_uncached = translator->cache->stats.uncached;
+    }
+}
+
+/* Translate a text of size bytes in memory. The translation is returned in a malloc()ed buffer, which is terminated
+ * with a NULL-character, too. Returns like loesung_translate_stream(), the output is only set on success. */
+int loesung_translate_buffer(struct Loesung_translator *translator, const char *input, size_t size, char **output,
+                             size_t *output_size) {
+    struct Output *out = &translator->out;
+    bool is_valid = true;
+
+    out->write = NULL;
+    out->length = 0;
+    out->failed = false;
+
+    int ret = translate_chunk(translator, out, (const unsigned char *) input, size, &is_valid);
+    if (ret == -1 || !output_write(out, "", 1))
+        return LOESUNG_NO_MEMORY;
+    if (!is_valid)
+        return LOESUNG_INVALID_INPUT;
+
+    *output = malloc(out->length);
+    if (*output == NULL)
+        return LOESUNG_NO_MEMORY;
+
+    memcpy(*output, out->data, out->length);
+    *output_size = out->length - 1;
+    return ret;
+}
+
+/* Read from fd in large blocks and translate it into the output buffer, which is handed to write whenever it is full
+ * and at the end. A word at the end of a block is moved to the front and translated with the next one. A read error is
+ * treated like an invalid character, but the last word is translated first. If write is loesung_write_fd(), the output
+ * is not copied but written with writev() straight from the block and the dictionary after every block. Returns
+ * LOESUNG_OK if all words are in the dictionary, LOESUNG_NOT_FOUND if not, or LOESUNG_NO_MEMORY or
+ * LOESUNG_INVALID_INPUT. */
+int loesung_translate_stream(struct Loesung_translator *translator, int fd, Loesung_write write, void *context) {
+    struct Output *out = &translator->out;
+    size_t capacity = INPUT_BLOCK_SIZE;
+    unsigned char *block = malloc(capacity);
+    if (block == NULL)
+        return LOESUNG_NO_MEMORY;
+
+    out->write = write;
+    out->context = context;
+    out->length = 0;
+    out->failed = false;
+    // Without memory for the iovecs the output is copied.
+    out->is_vectored = write == loesung_write_fd && start_vectored_output(out);
+
+    int ret = 0;
+    size_t filled = 0;
+    bool is_eof = false;
+    bool is_valid = true;
+
+    // Read block by block until you get to the end of the file.
+    while (!is_eof && is_valid && ret != -1) {
+        // Resize the block if a single word fills all of it by factor two.
+        if (filled == capacity) {
+            unsigned char *tmp = realloc(block, capacity *= 2);
+            if (!tmp) {
+                ret = -1;
+                break;
+            }
+            block = tmp;
+        }
+
+        ssize_t new_filled = read_chunk(fd, block, capacity, filled, false, &is_eof);
+        bool is_read_error = new_filled < 0;
+        if (is_read_error)
+            is_eof = true;
+        else
+            filled = (size_t) new_filled;
+
+        size_t len = chunk_length(block, filled, is_eof);
+        int chunk_ret = translate_chunk(translator, out, block, len, &is_valid);
+        ret = chunk_ret == -1 ? -1 : ret | chunk_ret;
+        is_valid = is_valid && !is_read_error;
+
+        memmove(block, block + len, filled - len);
+        filled -= len;
+    }
+
+    output_flush(out);
+    out->write = NULL;
+    out->is_vectored = false;
+    free(block);
+
+    if (ret == -1)
+        return LOESUNG_NO_MEMORY;
+    return is_valid ? ret : LOESUNG_INVALID_INPUT;
+}
+
+/* Return the error message for the result of a translation or NULL if there was no error. */
+const char *loesung_translation_error(int ret) {
+    if (ret == LOESUNG_NO_MEMORY)
+        return "Error: could not read form stdin - out of memory!";
+    if (ret == LOESUNG_INVALID_INPUT)
+        return "Error: wrong input format due to non valid character!";
+    return NULL;
+}
+
+/* Write function for a file descriptor, which is passed as context. Returns false on a write error. */
+bool loesung_write_fd(void *context, const unsigned char *data, size_t size) {
+    int fd = (int) (intptr_t) context;
+    size_t written = 0;
+
+    while (written < size) {
+        ssize_t bytes_written = write(fd, data + written, size - written);
+
+        if (bytes_written < 0 && errno != EINTR)
+            return false;
+        if (bytes_written > 0)
+            written += (size_t) bytes_written;
+    }
+
+    return true;
+}
+
+/* Functions for the output buffer. */
+/* Hand the buffer to its write function. A buffer without one can't be flushed, it only grows. */
+void output_flush(struct Output *out) {
+    if (out->is_vectored) {
+        output_flush_vectored(out);
+        return;
+    }
+    if (out->write == NULL)
+        return;
+
+    // Like with fprintf() before, failed writes don't change the result, the rest of the output is dropped.
+    if (out->length > 0 && !out->failed)
+        out->failed = !out->write(out->context, out->data, out->length);
+    out->length = 0;
+}
+
+/* Write the parts of a vectored output with writev(). A short write can end within a part, the rest is written with
+ * the next call. */
+void output_flush_vectored(struct Output *out) {
+    output_point(out, out->data + out->pointed, out->length - out->pointed);
+
+    int fd = (int) (intptr_t) out->context;
+    struct iovec *iov = out->iov;
+    size_t count = out->iov_count;
+
+    while (count > 0 && !out->failed) {
+        ssize_t bytes_written = writev(fd, iov, (int) count);
+
+        if (bytes_written < 0 && errno == EINTR)
+            continue;
+        if (bytes_written < 0) {
+            out->failed = true;
+            break;
+        }
+
+        size_t written = (size_t) bytes_written;
+        while (count > 0 && written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (unsigned char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+
+    out->iov_count = 0;
+    out->length = out->pointed = 0;
+}
+
+/* Append bytes to the output buffer. Returns false if it can't grow. */
+bool output_write(struct Output *out, const void *data, size_t size) {
+    if (out->capacity - out->length < size) {
+        output_flush(out);
+
+        if (out->capacity - out->length < size) {
+            size_t capacity = out->capacity;
+            while (capacity - out->length < size)
+                capacity *= 2;
+
+            unsigned char *tmp = realloc(out->data, capacity);
+            if (!tmp)
+                return false;
+            out->data = tmp;
+            out->capacity = capacity;
+        }
+    }
+
+    memcpy(out->data + out->length, data, size);
+    out->length += size;
+    return true;
+}
+
+/* Append bytes which stay where they are until the output is flushed: a vectored output points to them if they are
+ * long enough, otherwise they are copied. Returns false if the output can't grow. */
+bool output_reference(struct Output *out, const void *data, size_t size) {
+    if (!out->is_vectored || size < OUTPUT_REFERENCE_SIZE)
+        return output_write(out, data, size);
+
+    // Leave room for the copies in front and for the copies behind at the flush.
+    if (out->iov_count + 3 > OUTPUT_IOV_COUNT)
+        output_flush_vectored(out);
+
+    output_point(out, out->data + out->pointed, out->length - out->pointed);
+    out->pointed = out->length;
+    output_point(out, data, size);
+    return true;
+}
+
+/* Add a part to a vectored output, which has room for it. A part which continues the one before is merged with it. */
+void output_point(struct Output *out, const void *data, size_t size) {
+    struct iovec *last = out->iov_count > 0 ? &out->iov[out->iov_count - 1] : NULL;
+
+    if (last != NULL && (const unsigned char *) last->iov_base + last->iov_len == data)
+        last->iov_len += size;
+    else if (size > 0)
+        out->iov[out->iov_count++] = (struct iovec) {(void *) data, size};
+}
+
+/* Allocate the parts of a vectored output, unless it has them already. Returns false if there is not enough memory. */
+bool start_vectored_output(struct Output *out) {
+    if (out->iov == NULL)
+        out->iov = malloc(OUTPUT_IOV_COUNT * sizeof(struct iovec));
+
+    out->iov_count = out->pointed = 0;
+    return out->iov != NULL;
+}
+
+/* Functions for the translation. A lot of this comes from Benni. */
+/* Scan the letters of a word from cur on and hash them on the way. Returns the first character behind the word and
+ * sets hash to the hash of the word for the hash table. The vectorized versions check SCAN_WIDTH characters at once and
+ * feed their letters to the hash eight at a time right after, the letters behind the end of the word are masked out.
+ * The last characters of the chunk, too few for a vector, are scanned one by one and hashed the same way. The scalar
+ * version scans the word first and hashes it with hash_word(), which reads the letters in memory order. */
+const unsigned char *scan_letters(const unsigned char *cur, const unsigned char *end, uint64_t *hash) {
+    const unsigned char *word = cur;
+#ifdef SCAN_WIDTH
+    uint64_t h = HASH_START;
+    uint64_t chunk;
+
+    while ((size_t) (end - cur) >= SCAN_WIDTH) {
+        unsigned letters = scan_letter_mask(cur);
+        // Stop at the first character which is not a letter.
+        size_t len = letters != SCAN_FULL_MASK ? (size_t) __builtin_ctz(~letters) : SCAN_WIDTH;
+
+        // A chunk of eight characters never reaches behind the vector, which is in the cache anyway.
+        for (size_t i = 0; i < len; i += 8) {
+            memcpy(&chunk, cur + i, 8);
+            if (len - i < 8)
+                chunk &= UINT64_MAX >> (64u - 8u * (len - i));
+            HASH_CHUNK(h, chunk, len - i < 8 ? len - i : 8);
+        }
+
+        cur += len;
+        if (len < SCAN_WIDTH) {
+            *hash = HASH_FINISH(h, cur - word);
+            return cur;
+        }
+    }
+
+    const unsigned char *rest = cur;
+    while (cur < end && is_letter(*cur))
+        cur++;
+
+    // Nothing may be read behind the end, so the last letters are copied.
+    for (; rest < cur; rest += 8) {
+        size_t len = (size_t) (cur - rest) < 8 ? (size_t) (cur - rest) : 8;
+        chunk = 0;
+        memcpy(&chunk, rest, len);
+        HASH_CHUNK(h, chunk, len);
+    }
+
+    *hash = HASH_FINISH(h, cur - word);
+#else
+    while (cur < end && is_letter(*cur))
+        cur++;
+
+    *hash = hash_word(word, (size_t) (cur - word));
+#endif
+    return cur;
+}
+
+/* Scan the characters between words from cur on. Returns the first letter or invalid character. */
+const unsigned char *scan_delimiters(const unsigned char *cur, const unsigned char *end) {
+#ifdef SCAN_WIDTH
+    while ((size_t) (end - cur) >= SCAN_WIDTH) {
+        unsigned stops = scan_stop_mask(cur);
+
+        if (stops != 0)
+            return cur + __builtin_ctz(stops);
+        cur += SCAN_WIDTH;
+    }
+#endif
+
+    while (cur < end && !is_letter(*cur) && is_valid_character(*cur))
+        cur++;
+
+    return cur;
+}
+
+#if defined(SCAN_WIDTH) && SCAN_WIDTH == 32
+/* Return a bit for every letter of the 32 characters at cur. */
+unsigned scan_letter_mask(const unsigned char *cur) {
+    __m256i chars = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) cur), _mm256_set1_epi8(32));
+    // Characters above 127 are negative as signed chars, so they are no letters, too.
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('a' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), chars));
+
+    return (unsigned) _mm256_movemask_epi8(letters);
+}
+
+/* Return a bit for every letter and every invalid character of the 32 characters at cur. */
+unsigned scan_stop_mask(const unsigned char *cur) {
+    __m256i chars = _mm256_loadu_si256((const __m256i *) cur);
+    __m256i folded = _mm256_or_si256(chars, _mm256_set1_epi8(32));
+    __m256i letters = _mm256_and_si256(_mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)),
+                                       _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), folded));
+    // Control characters except the line break, DEL and everything above 127 (negative as signed chars).
+    __m256i invalid = _mm256_or_si256(
+            _mm256_andnot_si256(_mm256_cmpeq_epi8(chars, _mm256_set1_epi8('\n')),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8(' '), chars)),
+            _mm256_cmpeq_epi8(chars, _mm256_set1_epi8(127)));
+
+    return (unsigned) _mm256_movemask_epi8(_mm256_or_si256(letters, invalid));
+}
+#elif defined(SCAN_WIDTH)
+/* Return a bit for every letter of the 16 characters at cur. */
+unsigned scan_letter_mask(const unsigned char *cur) {
+    __m128i chars = _mm_or_si128(_mm_loadu_si128((const __m128i *) cur), _mm_set1_epi8(32));
+    // Characters above 127 are negative as signed chars, so they are no letters, too.
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('a' - 1)),
+                                    _mm_cmplt_epi8(chars, _mm_set1_epi8('z' + 1)));
+
+    return (unsigned) _mm_movemask_epi8(letters);
+}
+
+/* Return a bit for every letter and every invalid character of the 16 characters at cur. */
+unsigned scan_stop_mask(const unsigned char *cur) {
+    __m128i chars = _mm_loadu_si128((const __m128i *) cur);
+    __m128i folded = _mm_or_si128(chars, _mm_set1_epi8(32));
+    __m128i letters = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                                    _mm_cmplt_epi8(folded, _mm_set1_epi8('z' + 1)));
+    // Control characters except the line break, DEL and everything above 127 (negative as signed chars).
+    __m128i invalid = _mm_or_si128(_mm_andnot_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8('\n')),
+                                                    _mm_cmplt_epi8(chars, _mm_set1_epi8(' '))),
+                                   _mm_cmpeq_epi8(chars, _mm_set1_epi8(127)));
+
+    return (unsigned) _mm_movemask_epi8(_mm_or_si128(letters, invalid));
+}
+#endif
+
+/* Look up a word of len letters of the input in the word cache or the dictionary. hash is the hash of the word in
+ * lowercase. Returns its translation and sets translation_len to its length, or returns NULL if it is not in the
+ * dictionary. */
+const unsigned char *search_word(struct Loesung_translator *translator, const unsigned char *word, size_t len,
+                                 uint64_t hash, size_t *translation_len) {
+    return translator->cache != NULL ?
+           search_in_word_cache(translator->dict, translator->cache, word, len, hash, translation_len) :
+           search_in_dictionary(translator->dict, word, len, hash, translation_len);
+}
+
+/* Write the translation of translation_len characters of a word of len letters of the input (or the word itself in
+ * angle brackets if translation is NULL) to the output buffer. The word and the translation are referenced, so a
+ * vectored output doesn't copy them if they are long. Returns 1 if the word is not in the dictionary, otherwise 0, or
+ * -1 if the output buffer can't grow. */
+int write_word(struct Output *out, const unsigned char *word, size_t len, const unsigned char *translation,
+               size_t translation_len) {
+    // Print the original search pattern if it is not found in the dictionary.
+    if (translation == NULL)
+        return output_write(out, "<", 1) && output_reference(out, word, len) && output_write(out, ">", 1) ? 1 : -1;
+
+    // If the search pattern is found and a translation returned we maybe need to capitalize the first letter for
+    // output. The translation can't be changed in place, a dictionary image is mapped read-only.
+    if (is_uppercase(word[0])) {
+        unsigned char first = translation[0] & ~32u;
+        return output_write(out, &first, 1) && output_reference(out, translation + 1, translation_len - 1) ? 0 : -1;
+    }
+
+    return output_reference(out, translation, translation_len) ? 0 : -1;
+}
+
+/* Translate a chunk of the input which doesn't end within a word, see translate_batches(). A translator of a service
+ * acquires the dictionary in service for the chunk: a replaced dictionary is taken up between two chunks and the old
+ * one is not deleted before the chunk is done. The word cache is cleared when the dictionary changed, as its
+ * translations point into the old one. A vectored output points into the chunk and the dictionary, so it is flushed
+ * before either of them goes. */
+int translate_chunk(struct Loesung_translator *translator, struct Output *out, const unsigned char *data, size_t size,
+                    bool *is_valid) {
+    if (translator->service == NULL) {
+        int ret = translate_batches(translator, out, data, size, is_valid);
+        if (out->is_vectored)
+            output_flush_vectored(out);
+        return ret;
+    }
+
+    uint64_t generation;
+    translator->dict = acquire_dictionary(translator->service, &generation);
+    if (generation != translator->generation && translator->cache != NULL)
+        clear_word_cache(translator->cache);
+    translator->generation = generation;
+
+    int ret = translate_batches(translator, out, data, size, is_valid);
+    if (out->is_vectored)
+        output_flush_vectored(out);
+
+    loesung_release_dictionary(translator->service, translator->dict);
+    translator->dict = NULL;
+    return ret;
+}
+
+/* Translate the words of a chunk with the dictionary of the translator. Words are looked up right in the chunk, all the
+ * characters between words go to the output buffer in one go. The words are taken in batches: a batch is
+ * scanned and hashed first, then the lookups of all its words are prefetched, so the cache misses of a big hash table
+ * overlap instead of stalling one after the other. All words of the batch are looked up before the first one is
+ * written, the writes to the output buffer would hold the lookups back otherwise. Stops at an invalid character and
+ * sets is_valid to false. The words and bytes are counted in the translator. Returns 1 if a word is not in the
+ * dictionary, otherwise 0, or -1 if the output buffer can't grow. */
+int translate_batches(struct Loesung_translator *translator, struct Output *out, const unsigned char *data, size_t size,
+                      bool *is_valid) {
+    struct Batch_word batch[LOESUNG_MAX_BATCH_SIZE];
+    uint64_t hashes[LOESUNG_MAX_BATCH_SIZE];
+    const unsigned char *cur = data;
+    const unsigned char *end = data + size;
+    bool is_invalid = false;
+    int ret = 0;
+    // Counted in registers and added to the statistics once per chunk.
+    uint64_t words = 0;
+    uint64_t unknown = 0;
+
+    while (cur < end && !is_invalid) {
+        // Scan the letters of the words of a batch and the characters behind them. Did we read an illegal character?
+        // Then the batch ends and it is the last one. The words in front of it are printed anyway.
+        size_t count = 0;
+        while (count < translator->batch_size && cur < end && !is_invalid) {
+            struct Batch_word *item = &batch[count];
+            item->word = cur;
+            cur = scan_letters(cur, end, &hashes[count++]);
+            item->len = (size_t) (cur - item->word);
+            cur = scan_delimiters(cur, end);
+            item->gap_end = cur;
+            is_invalid = cur < end && !is_letter(*cur);
+        }
+
+        // An empty first word is prefetched, too, but not looked up.
+        if (count > 1)
+            prefetch_in_dictionary(translator->dict, hashes, count);
+
+        for (size_t i = 0; i < count; i++)
+            if (batch[i].len > 0)
+                batch[i].translation = search_word(translator, batch[i].word, batch[i].len, hashes[i],
+                                                   &batch[i].translation_len);
+
+        // Print the translations and the characters between the words without changing.
+        for (size_t i = 0; i < count; i++) {
+            const struct Batch_word *item = &batch[i];
+
+            if (item->len > 0) {
+                int word_ret = write_word(out, item->word, item->len, item->translation, item->translation_len);
+                if (word_ret == -1)
+                    return -1;
+                ret |= word_ret;
+                unknown += (uint64_t) word_ret;
+                words++;
+            }
+
+            if (!output_reference(out, item->word + item->len, (size_t) (item->gap_end - (item->word + item->len))))
+                return -1;
+        }
+    }
+
+    if (is_invalid)
+        *is_valid = false;
+
+    translator->stats.bytes += (uint64_t) (cur - data);
+    translator->stats.words += words;
+    translator->stats.unknown += unknown;
+    return ret;
+}
+
+/* Return the length of the part of the data which can be translated without cutting a word in two. That's everything
+ * up to the last character which is not a letter, or all of it at the end of the file. */
+size_t chunk_length(const unsigned char *data, size_t size, bool is_eof) {
+    if (is_eof)
+        return size;
+
+    while (size > 0 && is_letter(data[size - 1]))
+        size--;
+
+    return size;
+}
+
+/* Read from fd behind the filled bytes of the buffer. If fill is set, read until the buffer is full. Sets is_eof at the
+ * end of the file. Returns the new number of filled bytes or -1 on a read error. */
+ssize_t read_chunk(int fd, unsigned char *data, size_t capacity, size_t filled, bool fill, bool *is_eof) {
+    while (filled < capacity) {
+        ssize_t bytes_read = read(fd, data + filled, capacity - filled);
+
+        if (bytes_read < 0 && errno == EINTR)
+            continue;
+        if (bytes_read < 0)
+            return -1;
+        if (bytes_read == 0) {
+            *is_eof = true;
+            break;
+        }
+
+        filled += (size_t) bytes_read;
+        if (!fill)
+            break;
+    }
+
+    return (ssize_t) filled;
+}
+
+/* Helper functions to check if a character is capitalized or a letter. */
+bool is_uppercase(int input) {
+    return (((input >= 'A') && (input <= 'Z')));
+}
+
+bool is_letter(int input) {
+    return (((input >= 'A') && (input <= 'Z')) || ((input >= 'a' && input <= 'z')));
+}
+
+bool is_valid_character(int input) {
+    return ((input == '\n') || ((input >= ' ') && (input <= '~')));
+}
+
+/* Functions for the word cache. */
+/* Return the number of entries of a word cache for at least size entries, that's the next power of two. */
+uint64_t word_cache_entries(uint64_t size) {
+    uint64_t entries = 1;
+
+    while (entries < size)
+        entries *= 2;
+
+    return entries;
+}
+
+/* Create a word cache with at least size entries. Returns NULL if there is not enough memory. */
+struct Word_cache *create_word_cache(uint64_t size) {
+    struct Word_cache *cache = malloc(sizeof(struct Word_cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->size = word_cache_entries(size);
+    cache->entries = calloc(cache->size, sizeof(struct Word_cache_entry));
+    cache->stats = (struct Word_cache_stats) {0, 0, 0};
+
+    if (cache->entries == NULL) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/* Delete a word cache. */
+void delete_word_cache(struct Word_cache *cache) {
+    if (cache == NULL)
+        return;
+
+    free(cache->entries);
+    free(cache);
+}
+
+/* Empty all entries of a word cache, its counters stay. */
+void clear_word_cache(struct Word_cache *cache) {
+    memset(cache->entries, 0, cache->size * sizeof(struct Word_cache_entry));
+}
+
+/* Search for a word in the word cache first and in the dictionary if it is not in there. The result is cached with the
+ * length of the translation, also if the word is not in the dictionary. Frequent words stay in the cache as long as no
+ * other word gets their entry. */
+const unsigned char *search_in_word_cache(const struct Loesung_dictionary *dict, struct Word_cache *cache,
+                                          const unsigned char *word, size_t len, uint64_t hash,
+                                          size_t *translation_len) {
+    if (len > WORD_CACHE_WORD_SIZE) {
+        cache->stats.uncached++;
+        return search_in_dictionary(dict, word, len, hash, translation_len);
+    }
+
+    // Not every hash function spreads the low bits well, so mix it first.
+    struct Word_cache_entry *entry = &cache->entries[mix64(hash) & (cache->size - 1)];
+
+    if (entry->len == len && entry->hash == (uint32_t) hash) {
+        size_t i = 0;
+        while (i < len && entry->word[i] == (word[i] | 32u))
+            i++;
+
+        if (i == len) {
+            cache->stats.hits++;
+            *translation_len = entry->translation_len;
+            return entry->translation;
+        }
+    }
+
+    cache->stats.misses++;
+    const unsigned char *translation = search_in_dictionary(dict, word, len, hash, translation_len);
+    // A translation of 4 GB or more doesn't fit into an entry, which stays empty then.
+    entry->len = translation == NULL || *translation_len <= UINT32_MAX ? (uint8_t) len : 0;
+    entry->hash = (uint32_t) hash;
+    entry->translation = translation;
+    entry->translation_len = translation != NULL ? (uint32_t) *translation_len : 0;
+    for (size_t i = 0; i < len; i++)
+        entry->word[i] = word[i] | 32u;
+
+    return translation;
+}
+
+/* Functions for the parallel translation. */
+/* Worker thread: take the next chunk in input order, translate it into its output buffer and mark it as done. The
+ * dictionary is only read, so the workers share it without any locks. The translator of a worker has no output buffer
+ * of its own, it writes to the chunks. */
+void *translate_chunk_worker(void *arg) {
+    struct Chunk_queue *queue = arg;
+    const struct Loesung_translator *like = queue->translator;
+    // Without memory for the cache the worker goes without.
+    struct Loesung_translator translator = {like->dict, like->service, 0, NULL, like->batch_size,
+                                            {NULL, 0, 0, NULL, NULL, false, false, NULL, 0, 0},
+                                            {0, 0, 0, 0, 0, 0, 0}};
+    translator.cache = like->cache != NULL ? create_word_cache(like->cache->size) : NULL;
+
+    pthread_mutex_lock(&queue->mutex);
+    while (true) {
+        while (queue->taken == queue->submitted && !queue->is_finished)
+            pthread_cond_wait(&queue->work, &queue->mutex);
+        if (queue->taken == queue->submitted)
+            break;
+
+        struct Chunk *chunk = &queue->chunks[queue->taken++ % queue->chunk_count];
+        pthread_mutex_unlock(&queue->mutex);
+
+        chunk->ret = translate_chunk(&translator, &chunk->out, chunk->data, chunk->length, &chunk->is_valid);
+
+        pthread_mutex_lock(&queue->mutex);
+        chunk->is_done = true;
+        pthread_cond_broadcast(&queue->done);
+    }
+
+    add_translator_stats(queue->translator, &translator);
+    pthread_mutex_unlock(&queue->mutex);
+
+    delete_word_cache(translator.cache);
+    return NULL;
+}
+
+/* Add the counters of a translator to another one. The counters of the word cache are only added if both have one. */
+void add_translator_stats(struct Loesung_translator *total, const struct Loesung_translator *translator) {
+    total->stats.bytes += translator->stats.bytes;
+    total->stats.words += translator->stats.words;
+    total->stats.unknown += translator->stats.unknown;
+
+    if (total->cache != NULL && translator->cache != NULL) {
+        total->cache->stats.hits += translator->cache->stats.hits;
+        total->cache->stats.misses += translator->cache->stats.misses;
+        total->cache->stats.uncached += translator->cache->stats.uncached;
+    }
+}
+
+/* Fill the buffer of a chunk. The end of the previous chunk, which was cut off behind the last character that is not
+ * a letter, is moved to the front and the rest is read from fd. The buffer is resized if a single word fills all of
+ * it. Returns false if memory allocation fails, a read error marks the chunk as invalid. */
+bool fill_chunk(int fd, struct Chunk *chunk, const struct Chunk *previous, bool *is_eof) {
+    size_t filled = previous != NULL ? previous->filled - previous->length : 0;
+
+    chunk->length = chunk->filled = 0;
+    chunk->out.length = 0;
+    chunk->ret = 0;
+    chunk->is_valid = true;
+    chunk->is_done = false;
+
+    while (chunk->length == 0 && !*is_eof) {
+        if (filled >= chunk->capacity) {
+            size_t capacity = chunk->capacity;
+            while (filled >= capacity)
+                capacity *= 2;
+
+            unsigned char *tmp = realloc(chunk->data, capacity);
+            if (!tmp)
+                return false;
+            chunk->data = tmp;
+            chunk->capacity = capacity;
+        }
+
+        if (previous != NULL && chunk->filled == 0 && filled > 0)
+            memcpy(chunk->data, previous->data + previous->length, filled);
+
+        ssize_t new_filled = read_chunk(fd, chunk->data, chunk->capacity, filled, true, is_eof);
+        if (new_filled < 0) {
+            *is_eof = true;
+            chunk->is_valid = false;
+        } else
+            filled = (size_t) new_filled;
+
+        chunk->filled = filled;
+        chunk->length = chunk_length(chunk->data, filled, *is_eof);
+    }
+
+    return true;
+}
+
+/* Translate fd with a pool of threads, which translate like the given translator: with its dictionary or service, a
+ * word cache of the same size and the same batch size. The main thread reads chunks, cut behind the last character
+ * which is not a letter, into a ring of 2 * threads buffers. It hands the output of the oldest chunk to write as soon
+ * as it is done and reuses its buffer, so the output stays in input order. After a chunk with an invalid character
+ * nothing else is written. The counters of the workers are added to the translator. Returns like
+ * loesung_translate_stream(). */
+int loesung_translate_parallel(struct Loesung_translator *translator, int fd, Loesung_write write, void *context,
+                               long threads) {
+    struct Chunk_queue queue;
+    if (threads < 1)
+        threads = 1;
+    if (threads > LOESUNG_MAX_THREADS)
+        threads = LOESUNG_MAX_THREADS;
+    pthread_t *workers = malloc((size_t) threads * sizeof(pthread_t));
+    long started = 0;
+
+    queue.chunk_count = 2 * (uint64_t) threads;
+    queue.chunks = calloc(queue.chunk_count, sizeof(struct Chunk));
+    queue.submitted = queue.taken = 0;
+    queue.is_finished = false;
+    queue.translator = translator;
+    pthread_mutex_init(&queue.mutex, NULL);
+    pthread_cond_init(&queue.work, NULL);
+    pthread_cond_init(&queue.done, NULL);
+
+    bool is_allocated = workers != NULL && queue.chunks != NULL;
+    for (uint64_t i = 0; is_allocated && i < queue.chunk_count; i++) {
+        struct Chunk *chunk = &queue.chunks[i];
+        chunk->capacity = PARALLEL_CHUNK_SIZE;
+        chunk->data = malloc(chunk->capacity);
+        chunk->out = (struct Output) {malloc(OUTPUT_BUFFER_SIZE), 0, OUTPUT_BUFFER_SIZE, NULL, NULL, false, false,
+                                          NULL, 0, 0};
+        is_allocated = chunk->data != NULL && chunk->out.data != NULL;
+    }
+
+    while (is_allocated && started < threads &&
+           pthread_create(&workers[started], NULL, translate_chunk_worker, &queue) == 0)
+        started++;
+
+    int ret = started > 0 ? 0 : -1;
+    uint64_t written = 0;
+    bool is_eof = false;
+    bool is_valid = true;
+    bool failed = false;
+
+    while (ret != -1 && is_valid) {
+        // Read the next chunk if there is a free buffer in the ring.
+        if (!is_eof && queue.submitted - written < queue.chunk_count) {
+            struct Chunk *chunk = &queue.chunks[queue.submitted % queue.chunk_count];
+            ret = fill_chunk(fd, chunk, queue.submitted > 0 ? &queue.chunks[(queue.submitted - 1) % queue.chunk_count] :
+                                        NULL, &is_eof) ? ret : -1;
+
+            // Hand the chunk over to the workers.
+            pthread_mutex_lock(&queue.mutex);
+            queue.submitted++;
+            pthread_cond_signal(&queue.work);
+            pthread_mutex_unlock(&queue.mutex);
+            continue;
+        }
+
+        if (written == queue.submitted)
+            break;
+
+        // Wait for the oldest chunk and write its output.
+        struct Chunk *chunk = &queue.chunks[written++ % queue.chunk_count];
+        pthread_mutex_lock(&queue.mutex);
+        while (!chunk->is_done)
+            pthread_cond_wait(&queue.done, &queue.mutex);
+        pthread_mutex_unlock(&queue.mutex);
+
+        ret = chunk->ret == -1 ? -1 : ret | chunk->ret;
+        is_valid = chunk->is_valid;
+        chunk->out.write = write;
+        chunk->out.context = context;
+        chunk->out.failed = failed;
+        output_flush(&chunk->out);
+        failed = chunk->out.failed;
+        chunk->out.write = NULL;
+    }
+
+    // Let the workers finish what is left and stop.
+    pthread_mutex_lock(&queue.mutex);
+    queue.is_finished = true;
+    pthread_cond_broadcast(&queue.work);
+    pthread_mutex_unlock(&queue.mutex);
+
+    for (long i = 0; i < started; i++)
+        pthread_join(workers[i], NULL);
+
+    for (uint64_t i = 0; queue.chunks != NULL && i < queue.chunk_count; i++) {
+        free(queue.chunks[i].data);
+        free(queue.chunks[i].out.data);
+    }
+    free(queue.chunks);
+    free(workers);
+    pthread_cond_destroy(&queue.done);
+    pthread_cond_destroy(&queue.work);
+    pthread_mutex_destroy(&queue.mutex);
+
+    if (ret == -1)
+        return LOESUNG_NO_MEMORY;
+    return is_valid ? ret : LOESUNG_INVALID_INPUT;
+}
@@ -0,0 +1,448 @@
+#define _DEFAULT_SOURCE
+
+#include <stdbool.h>    // bool
+#include <stdint.h>     // uint8_t, uint32_t, uint64_t
+#include <stdlib.h>     // calloc, malloc, realloc, free, qsort
+#include <string.h>     // memcmp, memcpy, strcmp, strlen
+
+#include "loesung_internal.h"
+
+/**
+ * The trie of the library, a compact alternative to the hash table for big dictionaries whose words share a lot of
+ * prefixes. It is a radix trie: every edge holds the letters the words below it have in common, so a node is only
+ * needed where words branch off or end. Equal labels (mostly the endings of the words) and equal translations are
+ * stored once. The trie is built from the hash table, which has already checked the wb.file, and then takes its place.
+ */
+
+/* Data structure for an entry of the trie while it is built. The word is zero terminated, its translation follows.
+ * prefix holds the first eight letters, filled up with zeros, so most entries are sorted without touching the words. */
+struct Trie_entry {
+    uint64_t prefix;
+    const unsigned char *word;
+    uint32_t length;
+};
+
+/* Data structure for the words below a node while the trie is built: the entries lo to hi, which have the first depth
+ * letters in common with the label of the node. */
+struct Trie_range {
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t depth;
+};
+
+/* Function prototypes for the string pool. */
+uint32_t add_to_trie_pool(struct Trie_pool *, const unsigned char *, size_t);
+bool grow_trie_pool_index(struct Trie_pool *);
+void shrink_trie_pool(struct Trie_pool *);
+
+/* Function prototypes for the trie. */
+int compare_trie_entries(const void *, const void *);
+bool sort_trie_entries(struct Trie_entry *, uint64_t);
+struct Trie_entry *collect_trie_entries(struct HT_dictionary *, uint64_t);
+int add_trie_children(struct Trie *, struct Trie_range **, uint64_t *, uint64_t, const struct Trie_entry *);
+void move_trie_to_huge_region(struct Trie *);
+
+/* Functions for the string pool. */
+/* Add a string of len letters to the pool, unless it is in there already. Returns its offset or TRIE_NONE if there is
+ * not enough memory or the pool gets too big for 32 bit offsets. */
+uint32_t add_to_trie_pool(struct Trie_pool *pool, const unsigned char *string, size_t len) {
+    if (pool->count * 2 >= pool->index_size && !grow_trie_pool_index(pool))
+        return TRIE_NONE;
+
+    uint64_t mask = pool->index_size - 1;
+    uint64_t index = hash_word(string, len) & mask;
+
+    // Linear probing, the offsets are stored plus one, so zero is a free entry.
+    while (pool->index[index] != 0) {
+        const unsigned char *item = pool->data + pool->index[index] - 1;
+        if (memcmp(item, string, len) == 0 && item[len] == '\0')
+            return pool->index[index] - 1;
+        index = (index + 1) & mask;
+    }
+
+    if (pool->size + len + 1 >= TRIE_NONE)
+        return TRIE_NONE;
+
+    if (pool->capacity - pool->size < len + 1) {
+        uint64_t capacity = pool->capacity > 0 ? pool->capacity : TRIE_POOL_SIZE;
+        while (capacity - pool->size < len + 1)
+            capacity *= 2;
+
+        unsigned char *tmp = realloc(pool->data, capacity);
+        if (!tmp)
+            return TRIE_NONE;
+        pool->data = tmp;
+        pool->capacity = capacity;
+    }
+
+    uint32_t offset = (uint32_t) pool->size;
+    memcpy(pool->data + offset, string, len);
+    pool->data[offset + len] = '\0';
+    pool->size += len + 1;
+    pool->index[index] = offset + 1;
+    pool->count++;
+    return offset;
+}
+
+/* Double the index of the pool and insert all strings again. Returns false if there is not enough memory. */
+bool grow_trie_pool_index(struct Trie_pool *pool) {
+    uint64_t index_size = pool->index_size > 0 ? pool->index_size * 2 : TRIE_POOL_SIZE;
+    uint32_t *index = calloc(index_size, sizeof(uint32_t));
+
+    if (index == NULL)
+        return false;
+
+    for (uint64_t i = 0; i < pool->index_size; i++) {
+        if (pool->index[i] == 0)
+            continue;
+
+        const unsigned char *item = pool->data + pool->index[i] - 1;
+        uint64_t j = hash_word(item, strlen((const char *) item)) & (index_size - 1);
+        while (index[j] != 0)
+            j = (j + 1) & (index_size - 1);
+        index[j] = pool->index[i];
+    }
+
+    free(pool->index);
+    pool->index = index;
+    pool->index_size = index_size;
+    return true;
+}
+
+/* Drop the index of the pool once the trie is built and give back the spare memory. */
+void shrink_trie_pool(struct Trie_pool *pool) {
+    free(pool->index);
+    pool->index = NULL;
+    pool->index_size = pool->count = 0;
+
+    unsigned char *tmp = pool->size > 0 ? realloc(pool->data, pool->size) : NULL;
+    if (tmp) {
+        pool->data = tmp;
+        pool->capacity = pool->size;
+    }
+}
+
+/* Functions for the trie. */
+/* Compare two entries by their words. A word comes before all words it is the beginning of. Equal prefixes of
+ * words with less than eight letters are equal words, which the dictionary doesn't have. */
+int compare_trie_entries(const void *a, const void *b) {
+    const struct Trie_entry *entry_a = a;
+    const struct Trie_entry *entry_b = b;
+
+    if (entry_a->prefix != entry_b->prefix)
+        return entry_a->prefix < entry_b->prefix ? -1 : 1;
+    if (entry_a->length < 8 || entry_b->length < 8)
+        return (entry_a->length > entry_b->length) - (entry_a->length < entry_b->length);
+
+    return strcmp((const char *) entry_a->word + 8, (const char *) entry_b->word + 8);
+}
+
+/* Collect the entries of the hash table sorted by their words and store their count. The slots of the hash table are
+ * freed afterwards, they are not needed any more and the trie needs the memory. Returns NULL if there is not enough
+ * memory. */
+struct Trie_entry *collect_trie_entries(struct HT_dictionary *table, uint64_t entry_count) {
+    struct Trie_entry *entries = malloc((entry_count + 1) * sizeof(struct Trie_entry));
+    uint64_t count = 0;
+
+    if (entries == NULL)
+        return NULL;
+
+    for (uint64_t i = 0; i < table->dict_size && count < entry_count; i++) {
+        if (!(table->ctrl[i] & HT_FULL))
+            continue;
+
+        // The prefix is stored big-endian, so it is compared like the letters.
+        const unsigned char *word = table->blob + table->slots[i].offset;
+        uint64_t length = ht_slot_length(table, &table->slots[i]);
+        uint64_t prefix = 0;
+        for (uint32_t j = 0; j < 8; j++)
+            prefix = prefix << 8u | (j < length ? word[j] : 0u);
+        entries[count++] = (struct Trie_entry) {prefix, word, (uint32_t) length};
+    }
+
+    free_ht_storage(table);
+
+    if (!sort_trie_entries(entries, count)) {
+        free(entries);
+        return NULL;
+    }
+    return entries;
+}
+
+/* Sort the entries by their words. A radix sort on the prefixes does most of the work, a byte at a time from the last
+ * one, and skips the bytes which are the same for all entries. Only the entries with the same prefix are compared
+ * afterwards, that are the longer words with the same first eight letters. Returns false if there is not enough
+ * memory. */
+bool sort_trie_entries(struct Trie_entry *entries, uint64_t count) {
+    struct Trie_entry *tmp = malloc((count + 1) * sizeof(struct Trie_entry));
+    struct Trie_entry *from = entries;
+    struct Trie_entry *to = tmp;
+
+    if (tmp == NULL)
+        return false;
+
+    for (uint32_t shift = 0; shift < 64; shift += 8) {
+        uint64_t starts[257] = {0};
+
+        for (uint64_t i = 0; i < count; i++)
+            starts[((from[i].prefix >> shift) & 0xffu) + 1]++;
+
+        bool is_same = false;
+        for (uint32_t b = 0; b < 256; b++) {
+            is_same = is_same || starts[b + 1] == count;
+            starts[b + 1] += starts[b];
+        }
+        if (is_same)
+            continue;
+
+        for (uint64_t i = 0; i < count; i++)
+            to[starts[(from[i].prefix >> shift) & 0xffu]++] = from[i];
+
+        struct Trie_entry *swap = from;
+        from = to;
+        to = swap;
+    }
+
+    if (from != entries)
+        memcpy(entries, from, count * sizeof(struct Trie_entry));
+    free(tmp);
+
+    for (uint64_t lo = 0, hi = 0; lo < count; lo = hi) {
+        for (hi = lo + 1; hi < count && entries[hi].prefix == entries[lo].prefix;)
+            hi++;
+        if (hi - lo > 1)
+            qsort(entries + lo, hi - lo, sizeof(struct Trie_entry), compare_trie_entries);
+    }
+
+    return true;
+}
+
+/* Fill in node i of the trie: its label is what the entries of its range have in common, at most TRIE_LABEL_SIZE
+ * letters. A word which ends there gives the translation of the node, all others are split up by their next letter
+ * into the children, which are appended to the nodes. Returns LOESUNG_OK or LOESUNG_NO_MEMORY. */
+int add_trie_children(struct Trie *trie, struct Trie_range **ranges, uint64_t *capacity, uint64_t i,
+                      const struct Trie_entry *entries) {
+    struct Trie_range range = (*ranges)[i];
+    struct Trie_node *node = &trie->nodes[i];
+    const unsigned char *label = (const unsigned char *) "";
+    uint32_t label_length = 0;
+
+    // The entries are sorted, so the first and the last one have the least in common. The word which is shorter
+    // ends with a zero, that stops the loop, too.
+    if (range.lo < range.hi) {
+        const unsigned char *last = entries[range.hi - 1].word + range.depth;
+        label = entries[range.lo].word + range.depth;
+        while (label_length < TRIE_LABEL_SIZE && label[label_length] != '\0' &&
+               label[label_length] == last[label_length])
+            label_length++;
+    }
+
+    // Short labels are stored in the node itself.
+    if (label_length <= sizeof(node->label))
+        memcpy(&node->label, label, label_length);
+    else
+        node->label = add_to_trie_pool(&trie->labels, label, label_length);
+    node->label_length = (uint8_t) label_length;
+    node->translation = TRIE_NONE;
+    node->first_child = (uint32_t) trie->node_count;
+    node->child_count = 0;
+    if (label_length > sizeof(node->label) && node->label == TRIE_NONE)
+        return LOESUNG_NO_MEMORY;
+
+    uint32_t depth = range.depth + label_length;
+    uint32_t lo = range.lo;
+
+    if (lo < range.hi && entries[lo].length == depth) {
+        const unsigned char *translation = entries[lo].word + depth + 1;
+        node->translation = add_to_trie_pool(&trie->translations, translation, strlen((const char *) translation));
+        if (node->translation == TRIE_NONE)
+            return LOESUNG_NO_MEMORY;
+        lo++;
+    }
+
+    while (lo < range.hi) {
+        unsigned char letter = entries[lo].word[depth];
+        uint32_t hi = lo + 1;
+        while (hi < range.hi && entries[hi].word[depth] == letter)
+            hi++;
+
+        // Make room for the child, the node array moves then.
+        if (trie->node_count == *capacity) {
+            struct Trie_node *nodes = realloc(trie->nodes, *capacity * 2 * sizeof(struct Trie_node));
+            struct Trie_range *tmp = nodes != NULL ? realloc(*ranges, *capacity * 2 * sizeof(struct Trie_range)) : NULL;
+            if (nodes != NULL)
+                trie->nodes = nodes;
+            if (tmp == NULL)
+                return LOESUNG_NO_MEMORY;
+            *ranges = tmp;
+            *capacity *= 2;
+        }
+
+        trie->nodes[trie->node_count].first = letter;
+        (*ranges)[trie->node_count] = (struct Trie_range) {lo, hi, depth};
+        trie->node_count++;
+        trie->nodes[i].child_count++;
+        lo = hi;
+    }
+
+    return LOESUNG_OK;
+}
+
+/* Build the trie from the entry_count entries of the hash table, which is emptied on the way. The nodes are laid out
+ * breadth first, so the children of a node are next to each other and the nodes themselves are the queue of the nodes
+ * which still need their children. Returns LOESUNG_OK, LOESUNG_NO_MEMORY or LOESUNG_WRONG_FORMAT if the dictionary is
+ * too big for the trie. */
+int build_trie(struct Trie *trie, struct HT_dictionary *table, uint64_t entry_count, bool use_huge_pages) {
+    struct Trie_entry *entries = collect_trie_entries(table, entry_count);
+    uint64_t capacity = entry_count + 1;
+    struct Trie_range *ranges = malloc(capacity * sizeof(struct Trie_range));
+    int ret = entries != NULL && ranges != NULL ? LOESUNG_OK : LOESUNG_NO_MEMORY;
+
+    *trie = (struct Trie) {NULL, 0, {NULL, 0, 0, NULL, 0, 0}, {NULL, 0, 0, NULL, 0, 0}, {NULL, 0, false}};
+    if (ret == LOESUNG_OK && entry_count >= TRIE_NONE / 2)
+        ret = LOESUNG_WRONG_FORMAT;
+    if (ret == LOESUNG_OK && (trie->nodes = malloc(capacity * sizeof(struct Trie_node))) == NULL)
+        ret = LOESUNG_NO_MEMORY;
+
+    if (ret == LOESUNG_OK) {
+        // The root holds all entries.
+        trie->nodes[0].first = '\0';
+        ranges[0] = (struct Trie_range) {0, (uint32_t) entry_count, 0};
+        trie->node_count = 1;
+    }
+
+    for (uint64_t i = 0; ret == LOESUNG_OK && i < trie->node_count; i++) {
+        ret = add_trie_children(trie, &ranges, &capacity, i, entries);
+        if (ret == LOESUNG_OK && trie->node_count >= TRIE_NONE)
+            ret = LOESUNG_WRONG_FORMAT;
+    }
+
+    free(entries);
+    free(ranges);
+
+    if (ret != LOESUNG_OK) {
+        delete_trie(trie);
+        return ret;
+    }
+
+    struct Trie_node *nodes = realloc(trie->nodes, trie->node_count * sizeof(struct Trie_node));
+    if (nodes)
+        trie->nodes = nodes;
+    shrink_trie_pool(&trie->labels);
+    shrink_trie_pool(&trie->translations);
+    if (use_huge_pages)
+        move_trie_to_huge_region(trie);
+    return LOESUNG_OK;
+}
+
+/* Move the nodes and the strings of both pools of a built trie into one region for huge pages. The trie stays where
+ * it is if the region can't be mapped. */
+void move_trie_to_huge_region(struct Trie *trie) {
+    size_t nodes_size = trie->node_count * sizeof(struct Trie_node);
+    if (!map_huge_region(&trie->huge, nodes_size + trie->labels.size + trie->translations.size))
+        return;
+
+    unsigned char *data = trie->huge.data;
+    memcpy(data, trie->nodes, nodes_size);
+    free(trie->nodes);
+    trie->nodes = (struct Trie_node *) data;
+    data += nodes_size;
+
+    struct Trie_pool *pools[2] = {&trie->labels, &trie->translations};
+    for (int i = 0; i < 2; i++) {
+        if (pools[i]->size > 0)
+            memcpy(data, pools[i]->data, pools[i]->size);
+        free(pools[i]->data);
+        pools[i]->data = data;
+        pools[i]->capacity = pools[i]->size;
+        data += pools[i]->size;
+    }
+}
+
+/* Delete the trie. */
+void delete_trie(struct Trie *trie) {
+    if (trie->huge.data != NULL)
+        unmap_huge_region(&trie->huge);
+    else {
+        free(trie->nodes);
+        free(trie->labels.data);
+        free(trie->translations.data);
+    }
+    free(trie->labels.index);
+    free(trie->translations.index);
+    *trie = (struct Trie) {NULL, 0, {NULL, 0, 0, NULL, 0, 0}, {NULL, 0, 0, NULL, 0, 0}, {NULL, 0, false}};
+}
+
+/* Work out the statistics of the trie: the nodes are the slots and the probes of a word are the nodes on the way to
+ * it. The nodes are laid out breadth first, so the nodes of a level follow each other and the children of the last
+ * level end where the next level ends. */
+void trie_stats(const struct Trie *trie, struct Loesung_table_stats *table) {
+    uint64_t level_end = 1;
+    uint64_t next_level_end = 1;
+    uint64_t probes = 1;
+    uint64_t probes_hit = 0;
+
+    table->is_trie = true;
+    table->slots = trie->node_count;
+    table->memory = trie->node_count * sizeof(struct Trie_node) + trie->labels.capacity + trie->translations.capacity;
+
+    for (uint64_t i = 0; i < trie->node_count; i++) {
+        if (i == level_end) {
+            level_end = next_level_end;
+            probes++;
+        }
+        if (trie->nodes[i].first_child + trie->nodes[i].child_count > next_level_end)
+            next_level_end = trie->nodes[i].first_child + trie->nodes[i].child_count;
+
+        if (trie->nodes[i].translation == TRIE_NONE)
+            continue;
+
+        table->entries++;
+        table->probe_histogram[probes < LOESUNG_PROBE_BUCKETS ? probes - 1 : LOESUNG_PROBE_BUCKETS - 1]++;
+        probes_hit += probes;
+        if (probes > table->longest_probe)
+            table->longest_probe = probes;
+    }
+
+    table->mean_probes_hit = table->entries > 0 ? (double) probes_hit / (double) table->entries : 0;
+}
+
+/* Search for a word of len letters in any case in the trie. The word is walked letter by letter from the root: the
+ * letters have to match the label of a node and the letter behind the label picks the child. The first letter of the
+ * label matches already when the child is picked. Sets translation_len to the length of the translation, which is
+ * measured in the pool. */
+const unsigned char *search_in_trie(const struct Trie *trie, const unsigned char *word, size_t len,
+                                    size_t *translation_len) {
+    const struct Trie_node *node = trie->nodes;
+    size_t pos = 0;
+
+    while (true) {
+        const unsigned char *label = node->label_length <= sizeof(node->label) ?
+                                     (const unsigned char *) &node->label : trie->labels.data + node->label;
+
+        if (len - pos < node->label_length)
+            return NULL;
+        for (uint32_t i = node != trie->nodes; i < node->label_length; i++)
+            if (label[i] != (word[pos + i] | 32u))
+                return NULL;
+        pos += node->label_length;
+
+        if (pos == len && node->translation == TRIE_NONE)
+            return NULL;
+        if (pos == len) {
+            *translation_len = strlen((const char *) trie->translations.data + node->translation);
+            return trie->translations.data + node->translation;
+        }
+
+        // The children are ordered by their first letter.
+        unsigned char letter = word[pos] | 32u;
+        const struct Trie_node *child = trie->nodes + node->first_child;
+        const struct Trie_node *end = child + node->child_count;
+
+        while (child < end && child->first < letter)
+            child++;
+        if (child == end || child->first != letter)
+            return NULL;
+        node = child;
+    }
+}